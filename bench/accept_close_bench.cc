@@ -0,0 +1,95 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "EventLoop.h"
+#include "Logger.h"
+#include "TcpServer.h"
+
+// Connection churn through TcpServer: each client connects and sends one byte, the server
+// echoes it and closes, so every round trip pays accept, TcpConnection and Buffer setup and teardown.
+// Usage: accept_close_bench [port] [client threads] [seconds] [server io threads]
+
+namespace
+{
+    bool roundTrip(const sockaddr_in &addr)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            return false;
+        }
+        // The server closes first, so TIME_WAIT sockets do not use up the client's ephemeral ports
+        char c = 'x';
+        bool ok = ::connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) == 0 &&
+                  ::write(fd, &c, 1) == 1 &&
+                  ::read(fd, &c, 1) == 1 &&
+                  ::read(fd, &c, 1) == 0;
+        ::close(fd);
+        return ok;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint16_t port = static_cast<uint16_t>(argc > 1 ? atoi(argv[1]) : 9990);
+    int clients = argc > 2 ? atoi(argv[2]) : 4;
+    int seconds = argc > 3 ? atoi(argv[3]) : 3;
+    int ioThreads = argc > 4 ? atoi(argv[4]) : 2;
+
+    // Per connection INFO lines would dominate the measurement
+    Logger::setLogLevel(Logger::WARN);
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "AcceptCloseBench");
+    server.setThreadNum(ioThreads);
+    server.setConnectionCallback([](const TcpConnectionPtr &) {});
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                              {
+                                  conn->send(std::move(*buf));
+                                  conn->shutdown();
+                              });
+    server.start();
+
+    std::atomic<long> connections(0);
+    std::atomic<long> failures(0);
+    std::thread driver([&]()
+                       {
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < clients; ++i)
+        {
+            threads.emplace_back([&]()
+                                 {
+                while (std::chrono::steady_clock::now() < deadline)
+                {
+                    (roundTrip(addr) ? connections : failures).fetch_add(1, std::memory_order_relaxed);
+                } });
+        }
+        for (std::thread &t : threads)
+        {
+            t.join();
+        }
+        loop.queueInLoop([&loop]()
+                         { loop.quit(); }); });
+
+    loop.loop();
+    driver.join();
+
+    printf("clients=%d io threads=%d %.0f conn/s failures=%ld\n",
+           clients, ioThreads, connections.load() / static_cast<double>(seconds), failures.load());
+    return 0;
+}
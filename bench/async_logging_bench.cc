@@ -0,0 +1,135 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AsyncLogging.h"
+
+// Many producer threads logging into one AsyncLogging at once, the contention the per-thread
+// StagingBuffers are meant to remove. Reports lines/s and checks after stop() that every line
+// that was not counted as dropped is in the log files.
+// Usage: async_logging_bench [threads] [seconds] [dir] [drop]
+//        drop: use kDropNewest instead of the default kBlock
+
+namespace
+{
+    // Count log lines in the files of dir written by the bench
+    long countLines(const std::string &dir)
+    {
+        long lines = 0;
+        DIR *d = ::opendir(dir.c_str());
+        if (d == nullptr)
+        {
+            return -1;
+        }
+        while (struct dirent *entry = ::readdir(d))
+        {
+            if (strncmp(entry->d_name, "bench.", 6) != 0)
+            {
+                continue;
+            }
+            FILE *file = ::fopen((dir + "/" + entry->d_name).c_str(), "r");
+            if (file == nullptr)
+            {
+                continue;
+            }
+            char buf[64 * 1024];
+            size_t n;
+            while ((n = ::fread(buf, 1, sizeof(buf), file)) > 0)
+            {
+                for (size_t i = 0; i < n; ++i)
+                {
+                    lines += buf[i] == '\n';
+                }
+            }
+            ::fclose(file);
+        }
+        ::closedir(d);
+        return lines;
+    }
+
+    void removeLogs(const std::string &dir)
+    {
+        DIR *d = ::opendir(dir.c_str());
+        if (d == nullptr)
+        {
+            return;
+        }
+        while (struct dirent *entry = ::readdir(d))
+        {
+            if (strncmp(entry->d_name, "bench.", 6) == 0)
+            {
+                ::unlink((dir + "/" + entry->d_name).c_str());
+            }
+        }
+        ::closedir(d);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 16;
+    double seconds = argc > 2 ? atof(argv[2]) : 3;
+    std::string dir = argc > 3 ? argv[3] : "/tmp/rain_log_bench";
+    bool drop = argc > 4 && strcmp(argv[4], "drop") == 0;
+
+    ::mkdir(dir.c_str(), 0755);
+    removeLogs(dir);
+    long appended = 0;
+    uint64_t dropped = 0;
+    double elapsed = 0;
+    {
+        AsyncLogging log(dir + "/bench", 1LL << 40, 1);
+        if (drop)
+        {
+            log.setOverflowPolicy(AsyncLogging::kDropNewest);
+        }
+        log.start();
+
+        std::vector<long> counts(threads);
+        std::vector<std::thread> producers;
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+        for (int t = 0; t < threads; ++t)
+        {
+            producers.emplace_back([&, t]()
+                                   {
+                char line[128];
+                long i = 0;
+                while (std::chrono::steady_clock::now() < deadline)
+                {
+                    int n = snprintf(line, sizeof(line), "2026/10/17 12:00:00.123456 INFO  tid=%02d seq=%08ld some log message payload - bench.cc:42\n", t, i++);
+                    log.append(line, n);
+                }
+                counts[t] = i; });
+        }
+        for (std::thread &producer : producers)
+        {
+            producer.join();
+        }
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        log.stop();
+        dropped = log.droppedLines();
+        for (long count : counts)
+        {
+            appended += count;
+        }
+    }
+
+    // The backend also writes a line each time it reports dropped lines
+    long written = countLines(dir);
+    long missing = appended - static_cast<long>(dropped) - written;
+    printf("threads=%d %s %.2f M lines/s appended=%ld dropped=%llu written=%ld missing=%ld\n",
+           threads, drop ? "kDropNewest" : "kBlock", appended / elapsed / 1e6, appended,
+           static_cast<unsigned long long>(dropped), written, missing > 0 ? missing : 0);
+    removeLogs(dir);
+    return 0;
+}
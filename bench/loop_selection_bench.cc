@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+#include "InetAddress.h"
+#include "Logger.h"
+
+// Load imbalance of the EventLoopThreadPool selection policies.
+// Opens connections through getNextLoop() and closes them through releaseLoop(), a quarter of them
+// long lived, and reports the live connections per loop at the end: max/avg is the imbalance.
+// Runs with peers spread evenly over many ips, and with most peers behind one NAT ip.
+// Usage: loop_selection_bench [loops] [connections]
+
+namespace
+{
+    struct Connection
+    {
+        EventLoop *loop;
+        bool longLived;
+    };
+
+    void run(EventLoopThreadPool &pool, const char *name, bool skewed, long connections)
+    {
+        std::mt19937 rng(1);
+        std::vector<InetAddress> ips;
+        for (int i = 0; i < 256; ++i)
+        {
+            ips.push_back(InetAddress(8080, "192.168." + std::to_string(i / 16) + "." + std::to_string(i % 16)));
+        }
+        const InetAddress nat(8080, "10.0.0.1");
+        const size_t kLive = 2000;
+
+        std::vector<Connection> live;
+        auto start = std::chrono::steady_clock::now();
+        for (long i = 0; i < connections; ++i)
+        {
+            // Skewed: 90% of the peers come from the same NAT address
+            const InetAddress &ip = skewed && rng() % 10 != 0 ? nat : ips[rng() % ips.size()];
+            live.push_back(Connection{pool.getNextLoop(ip), rng() % 4 == 0});
+            if (live.size() > kLive)
+            {
+                // Close a random short lived connection, long lived ones stay to the end
+                size_t k = rng() % live.size();
+                if (!live[k].longLived)
+                {
+                    pool.releaseLoop(live[k].loop);
+                    live[k] = live.back();
+                    live.pop_back();
+                }
+            }
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / connections;
+
+        std::vector<int> loads = pool.loads();
+        int maxLoad = *std::max_element(loads.begin(), loads.end());
+        int minLoad = *std::min_element(loads.begin(), loads.end());
+        long sum = 0;
+        for (int load : loads)
+        {
+            sum += load;
+        }
+        printf("%-8s %-7s live=%ld max=%d min=%d max/avg=%.2f %.0f ns/connection\n",
+               skewed ? "skewed" : "uniform", name, sum, maxLoad, minLoad,
+               maxLoad * static_cast<double>(loads.size()) / sum, ns);
+
+        for (Connection &conn : live)
+        {
+            pool.releaseLoop(conn.loop);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int loops = argc > 1 ? atoi(argv[1]) : 8;
+    long connections = argc > 2 ? atol(argv[2]) : 100000;
+
+    Logger::setLogLevel(Logger::WARN);
+    EventLoop baseLoop;
+    EventLoopThreadPool pool(&baseLoop, "SelectionBench");
+    pool.setThreadNum(loops);
+    pool.start();
+
+    const std::pair<EventLoopThreadPool::Selection, const char *> policies[] = {
+        {EventLoopThreadPool::kRoundRobin, "rr"},
+        {EventLoopThreadPool::kLeastConnections, "least"},
+        {EventLoopThreadPool::kPowerOfTwoChoices, "p2c"},
+        {EventLoopThreadPool::kIpAffinity, "ip"},
+        {EventLoopThreadPool::kBoundedIpAffinity, "bounded"},
+    };
+    for (bool skewed : {false, true})
+    {
+        for (const auto &policy : policies)
+        {
+            pool.setSelection(policy.first);
+            run(pool, policy.second, skewed, connections);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "MpscQueue.h"
+
+// Producers push functors to one consumer, like queueInLoop() into an EventLoop.
+// Compares the mutex + vector swap EventLoop used before with MpscQueue, and checks
+// that each producer's functors run in push order.
+// Usage: mpsc_queue_bench [producers] [functors per producer] [ring capacity]
+
+using Functor = std::function<void()>;
+
+namespace
+{
+    struct MutexQueue
+    {
+        void push(Functor f)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(std::move(f));
+        }
+
+        size_t popAll(std::vector<Functor> &out)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            out.swap(pending);
+            return out.size();
+        }
+
+        std::mutex mutex;
+        std::vector<Functor> pending;
+    };
+
+    template <typename Queue>
+    void run(const char *name, Queue &queue, int producers, long perProducer)
+    {
+        std::vector<long> last(producers, -1);
+        long ran = 0;
+        long outOfOrder = 0;
+        const long total = producers * perProducer;
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int p = 0; p < producers; ++p)
+        {
+            threads.emplace_back([&, p]()
+                                 {
+                for (long i = 0; i < perProducer; ++i)
+                {
+                    // Runs on the consumer thread only, no synchronization needed
+                    queue.push([&, p, i]()
+                               {
+                        if (last[p] + 1 != i)
+                        {
+                            ++outOfOrder;
+                        }
+                        last[p] = i;
+                        ++ran; });
+                } });
+        }
+
+        std::vector<Functor> functors;
+        while (ran < total)
+        {
+            if (queue.popAll(functors) == 0)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            for (Functor &f : functors)
+            {
+                f();
+            }
+            functors.clear();
+        }
+        for (std::thread &t : threads)
+        {
+            t.join();
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%-6s producers=%d functors=%ld %.2f Mops/s %.1f ns/op out of order=%ld\n",
+               name, producers, total, total / seconds / 1e6, seconds * 1e9 / total, outOfOrder);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int producers = argc > 1 ? atoi(argv[1]) : 4;
+    long perProducer = argc > 2 ? atol(argv[2]) : 500000;
+    size_t capacity = argc > 3 ? static_cast<size_t>(atol(argv[3])) : 1024;
+
+    MutexQueue mutexQueue;
+    run("mutex", mutexQueue, producers, perProducer);
+
+    MpscQueue<Functor> mpscQueue(capacity);
+    run("mpsc", mpscQueue, producers, perProducer);
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "EventLoop.h"
+#include "Logger.h"
+
+// TimerQueue cost in the loop thread with many live timers, the load idle timeouts put on it:
+// add, cancel, cancel + re-add (an idle timeout pushed back by traffic), and how late timers fire.
+// Usage: timer_queue_bench [live timers] [re-arm operations]
+
+namespace
+{
+    double nsPerOp(std::chrono::steady_clock::time_point start, long ops)
+    {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ops;
+    }
+
+    void runTimerOps(EventLoop *loop, int timers, long rearms)
+    {
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<double> idle(1.0, 60.0);
+        std::vector<TimerId> ids(timers);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < timers; ++i)
+        {
+            ids[i] = loop->runAfter(idle(rng), []() {});
+        }
+        printf("add     %8d timers  %7.1f ns/op\n", timers, nsPerOp(start, timers));
+
+        start = std::chrono::steady_clock::now();
+        for (long i = 0; i < rearms; ++i)
+        {
+            TimerId &id = ids[rng() % timers];
+            loop->cancel(id);
+            id = loop->runAfter(idle(rng), []() {});
+        }
+        printf("re-arm  %8ld ops     %7.1f ns/op\n", rearms, nsPerOp(start, rearms));
+
+        start = std::chrono::steady_clock::now();
+        for (TimerId &id : ids)
+        {
+            loop->cancel(id);
+        }
+        printf("cancel  %8d timers  %7.1f ns/op\n", timers, nsPerOp(start, timers));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int timers = argc > 1 ? atoi(argv[1]) : 100000;
+    long rearms = argc > 2 ? atol(argv[2]) : 1000000;
+
+    Logger::setLogLevel(Logger::WARN);
+    EventLoop loop;
+    loop.runInLoop([&]()
+                   { runTimerOps(&loop, timers, rearms); });
+
+    // Timers due within 0.1-0.3s, measure how late the callbacks run
+    const int firing = timers < 10000 ? timers : 10000;
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> due(0.1, 0.3);
+    int fired = 0;
+    int64_t totalLateUs = 0;
+    int64_t maxLateUs = 0;
+    for (int i = 0; i < firing; ++i)
+    {
+        Timestamp when = addTime(Timestamp::now(), due(rng));
+        loop.runAt(when, [&, when]()
+                   {
+            int64_t late = Timestamp::now().microSecondsSinceEpoch() - when.microSecondsSinceEpoch();
+            totalLateUs += late;
+            maxLateUs = late > maxLateUs ? late : maxLateUs;
+            if (++fired == firing)
+            {
+                loop.quit();
+            } });
+    }
+    loop.loop();
+    printf("fire    %8d timers  late avg %.1f us max %lld us\n",
+           fired, static_cast<double>(totalLateUs) / fired, static_cast<long long>(maxLateUs));
+    return 0;
+}
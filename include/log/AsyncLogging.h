@@ -1,19 +1,34 @@
 #pragma once
 
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <vector>
 
 #include "FixedBuffer.h"
 #include "LogFile.h"
+#include "Logger.h"
 #include "LogStream.h"
+#include "StagingBuffer.h"
 #include "Thread.h"
 #include "noncopyable.h"
 
 class AsyncLogging
 {
 public:
+    // 后端写得太慢, 缓冲区都满了之后新日志的处理方式
+    enum OverflowPolicy
+    {
+        kBlock,          // 等待后端腾出空间, 超时后丢弃
+        kDropNewest,     // 直接丢弃新日志
+        kDropDebugFirst, // DEBUG和TRACE直接丢弃, 其他等级等待, 超时后丢弃
+    };
+
     AsyncLogging(const std::string &basename, off_t rollSize, int flushInterval = 3);
     ~AsyncLogging()
     {
@@ -24,16 +39,59 @@ public:
     }
 
     // Front-End Interface
+    // 每个线程第一次调用时注册自己的StagingBuffer, 之后只写本线程的环形缓冲区, 线程之间不竞争锁
+    // 在start()之前, 或者一行日志比StagingBuffer还大时, 写入加锁的共享缓冲区
     void append(const char *logline, int len);
+    // 写入一条BinaryLog记录, 作为BinaryLog的输出函数; 不是二进制模式时在调用线程渲染成文本
+    void appendBinary(const char *record, int len, Logger::LogLevel level);
     void start()
     {
         running_ = true;
         thread_.start();
     }
+    // 日志线程绑核, 需要在start()之前调用
+    void setCpuAffinity(const std::vector<int> &cpus) { thread_.setCpuAffinity(cpus); }
+    // 每个前端线程的StagingBuffer大小(字节, 默认256KB, 向上取整到2的幂), 需要在第一条日志之前设置
+    void setThreadBufferSize(size_t bytes) { threadBufferSize_ = bytes; }
+    // 后端每次取出各线程的日志后按写入时间归并再写文件, 否则按线程依次写入(同一线程内总是有序的)
+    // 归并需要每行多记录一个时间戳, 需要在第一条日志之前设置
+    void setMergeByTime(bool on) { mergeByTime_ = on; }
+    // 二进制模式: 写入.blog文件, BinaryLog记录原样写入, 文本日志行包装成文本记录, 用raindecode查看, 需要在start()之前设置
+    void setBinary(bool on) { binary_ = on; }
+    // 共享缓冲区队列最多排队的LargeBuffer个数(默认16), 所有缓冲区从空闲池中复用, 总数不超过它加3, 需要在start()之前设置
+    void setMaxQueuedBuffers(size_t maxBuffers) { maxQueuedBuffers_ = maxBuffers < 1 ? 1 : maxBuffers; }
+    // 缓冲区满时的处理方式(默认kBlock, 最多等待100ms), 丢弃的行数会定期写入日志
+    void setOverflowPolicy(OverflowPolicy policy, std::chrono::milliseconds blockTimeout = std::chrono::milliseconds(100))
+    {
+        overflowPolicy_ = policy;
+        blockTimeout_ = blockTimeout;
+    }
+    // 每个日志文件创建时用fallocate预分配rollSize字节, 写入时不再分配磁盘块, 关闭时释放没用完的部分, 需要在start()之前设置
+    void setPreallocate(bool on) { fileOptions_.preallocate = on ? rollSize_ : 0; }
+    // 用O_DIRECT按4KB对齐的整块写文件, 日志不占用页缓存, 需要在start()之前设置
+    void setDirectIO(bool on) { fileOptions_.directIO = on; }
+    // 落盘策略(默认kSyncNever): 每写入every字节或每every毫秒fdatasync一次, 崩溃时最多丢失这之间的日志, 需要在start()之前设置
+    void setSyncPolicy(FileUtil::SyncPolicy policy, int64_t every = 0)
+    {
+        fileOptions_.syncPolicy = policy;
+        fileOptions_.syncEvery = every;
+    }
+    // 启动以来丢弃的日志行数和字节数
+    uint64_t droppedLines() const { return droppedLines_.load(std::memory_order_relaxed); }
+    uint64_t droppedBytes() const { return droppedBytes_.load(std::memory_order_relaxed); }
+
+    // 停止后端线程, 等它把已经写入的日志全部写到文件
     void stop()
     {
-        running_ = false;
+        {
+            std::lock_guard<std::mutex> lg(mutex_);
+            running_ = false;
+        }
         cond_.notify_one();
+        if (thread_.started())
+        {
+            thread_.join();
+        }
     }
 
 private:
@@ -44,16 +102,59 @@ private:
 
     void threadFunc();
 
+    // 写入一行日志或者一条二进制记录, recordHeader不为空时写在data之前, level小于0时从文本行中取出
+    void appendRecord(const char *recordHeader, size_t recordHeaderLen, const char *data, int len, int level);
+    // 写入加锁的共享缓冲区
+    void appendLocked(const char *recordHeader, size_t recordHeaderLen, const char *data, int len, int level);
+    static void appendTo(LargeBuffer *buffer, const char *recordHeader, size_t recordHeaderLen, const char *data, int len);
+    // 缓冲区满时按overflowPolicy_判断这一行是否直接丢弃
+    bool dropWithoutWaiting(const char *data, int len, int level) const;
+    void countDropped(int len);
+    // 从空闲池取一个缓冲区, 池空且总数没有达到上限时新建, 调用者加锁
+    BufferPtr takeFreeBufferLocked();
+    // 后端: 丢弃的行数有变化时写一行统计
+    void reportDropped(LogFile &output);
+    // 后端: 二进制模式下写入新注册的格式, 在写入引用它们的记录之前调用
+    void writeDictionary(LogFile &output);
+    // 返回本线程的StagingBuffer, 第一次调用时创建并注册
+    StagingBuffer *threadBuffer();
+    // 后端: 把所有StagingBuffer中的日志写入output, 去掉已经退出且写完的线程的缓冲区
+    void drainStagings(LogFile &output);
+    // 后端: 停止时等待正在写StagingBuffer的前端线程写完, 之后的最后一轮不会漏掉它们的日志
+    void waitForStagingWriters();
+    void writeMerged(LogFile &output);
+
     // Flush for LogFile
     const int flushInterval_;
     std::atomic<bool> running_;
     const std::string basename_;
     const off_t rollSize_;
+    FileUtil::Options fileOptions_;
     Thread thread_;
     std::mutex mutex_;
     std::condition_variable cond_;
+    std::condition_variable spaceCond_; // 后端写完一批日志, 唤醒等待共享缓冲区或StagingBuffer空间的前端
 
     BufferPtr currentBuffer_;
-    BufferPtr nextBuffer_;
-    BufferVector buffers_;
+    BufferVector buffers_;     // 写满等待后端写入的缓冲区
+    BufferVector freeBuffers_; // 后端写完回收的空闲缓冲区
+    size_t allocatedBuffers_;  // 已经创建的缓冲区总数
+    size_t maxQueuedBuffers_;
+    OverflowPolicy overflowPolicy_;
+    std::chrono::milliseconds blockTimeout_;
+    std::atomic<uint64_t> droppedLines_;
+    std::atomic<uint64_t> droppedBytes_;
+    uint64_t reportedDroppedLines_; // 已经写入日志的丢弃行数, 只在后端线程使用
+
+    const uint64_t id_; // 区分AsyncLogging对象, 线程局部的StagingBuffer按它查找
+    size_t threadBufferSize_;
+    bool mergeByTime_;
+    bool binary_;
+    uint32_t dictionaryWritten_; // 当前文件中已经写入的格式个数, 只在后端线程使用
+    std::atomic<bool> stagingFull_; // 有StagingBuffer积压过半或写满, 需要后端尽快取走
+    std::mutex stagingMutex_; // 只在注册新线程和后端取列表时加锁
+    std::vector<std::shared_ptr<StagingBuffer>> stagings_;
+    std::vector<std::string> mergeScratch_; // 归并时各线程的日志拷贝, 只在后端线程使用
+    std::string mergeOutput_;               // 归并结果, 只在后端线程使用
+    static std::atomic<uint64_t> s_nextId_;
 };
\ No newline at end of file
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <functional>
+#include <string>
+#include <type_traits>
+
+#include "Logger.h"
+
+/**
+ * @brief 二进制日志: 调用处只写入格式的编号和参数的原始字节, 格式化推迟到raindecode离线完成
+ * 跳过LogStream和时间格式化, 每行的开销和体积都远小于文本日志
+ * 用法和printf一样, 格式字符串必须是字符串字面量:
+ *   LOGB_INFO("new connection %s fd=%d", name.c_str(), fd);
+ * 输出通过setOutput()设置, 一般交给AsyncLogging::appendBinary(), 在AsyncLogging::setBinary(true)时写入.blog文件
+ *
+ * 记录格式(本机字节序): RecordHeader + 参数
+ *   整数按类型写入4或8字节, 浮点数8字节, 字符串为4字节长度加内容, 指针8字节
+ * 格式字典(编号 -> 格式字符串, 文件名, 行号, 等级, 参数类型)也以记录写入文件, 每个文件开头有完整的字典
+ */
+class BinaryLog
+{
+public:
+    // 输出一条编码好的记录, level用于AsyncLogging的溢出策略
+    using OutputFunc = std::function<void(const char *record, int len, Logger::LogLevel level)>;
+
+    struct RecordHeader
+    {
+        uint32_t formatId; // 格式编号, kTextFormatId和kDictionaryId是特殊记录
+        uint32_t length;   // 整条记录的字节数, 包括RecordHeader
+        int64_t time;      // 微秒时间戳
+    };
+
+    // 一个调用处的格式信息
+    struct Format
+    {
+        uint32_t id;
+        int level;
+        int line;
+        std::string file; // 只保留文件名
+        std::string format;
+        std::string argTypes; // 每个参数一个类型字符, 见ArgType
+    };
+
+    static const uint32_t kTextFormatId = 0;          // 文本日志行, 内容是完整的一行
+    static const uint32_t kDictionaryId = 0xFFFFFFFF; // 格式字典中的一项, 内容见appendDictionary()
+    static const char kFileMagic[8];                  // 每个二进制日志文件的开头
+    static const int kMaxRecordSize = 4096;           // 超出的字符串参数被截断
+
+    static void setOutput(OutputFunc out);
+
+    // 注册一个调用处的格式, 每个调用处只在第一次执行时调用一次, 返回格式编号
+    static uint32_t registerFormat(Logger::LogLevel level, const char *file, int line, const char *format, const char *argTypes);
+
+    // 已注册的格式个数, 编号从1到formatCount()
+    static uint32_t formatCount();
+
+    // 把编号在[firstId, lastId]之间的格式以字典记录追加到out
+    static void appendDictionary(uint32_t firstId, uint32_t lastId, std::string *out);
+
+    // 解析一条字典记录, 失败返回false
+    static bool parseDictionary(const char *payload, size_t len, Format *format);
+
+    // 按format把参数渲染成与Logger相同格式的一行文本, 追加到out, 参数不完整返回false
+    static bool formatRecord(const Format &format, int64_t time, const char *args, size_t len, std::string *out);
+
+    // 把本进程产生的一条记录渲染成文本, 没有二进制输出时使用
+    static bool formatRecord(const char *record, int len, std::string *out);
+
+    // 编码一条记录并输出, 由LOGB_XXX调用
+    template <typename... Args>
+    static void write(uint32_t formatId, Logger::LogLevel level, const Args &...args)
+    {
+        char record[kMaxRecordSize];
+        size_t len = sizeof(RecordHeader);
+        int dummy[] = {0, (len = encode(record, len, args), 0)...};
+        (void)dummy;
+        RecordHeader header = {formatId, static_cast<uint32_t>(len), Timestamp::now().microSecondsSinceEpoch()};
+        memcpy(record, &header, sizeof(header));
+        output(record, static_cast<int>(len), level);
+    }
+
+    // 参数类型字符串, 只用于decltype, 不对参数求值
+    template <typename... Args>
+    struct ArgTypes
+    {
+        static const char *get()
+        {
+            static const char types[] = {typeOf<typename std::decay<Args>::type>()..., '\0'};
+            return types;
+        }
+    };
+    template <typename... Args>
+    static ArgTypes<Args...> argTypesOf(const Args &...);
+
+private:
+    enum ArgType
+    {
+        kInt32 = 'i',
+        kUint32 = 'I',
+        kInt64 = 'l',
+        kUint64 = 'L',
+        kDouble = 'd',
+        kString = 's',
+        kPointer = 'p',
+    };
+
+    static void output(const char *record, int len, Logger::LogLevel level);
+
+    template <typename T>
+    static constexpr char typeOf()
+    {
+        static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value ||
+                          std::is_same<T, std::string>::value,
+                      "LOGB_XXX only takes numbers, enums, pointers, C strings and std::string");
+        return std::is_same<T, std::string>::value || std::is_same<T, const char *>::value || std::is_same<T, char *>::value
+                   ? kString
+               : std::is_pointer<T>::value          ? kPointer
+               : std::is_floating_point<T>::value   ? kDouble
+               : std::is_enum<T>::value             ? (sizeof(T) > 4 ? kInt64 : kInt32)
+               : std::is_signed<T>::value           ? (sizeof(T) > 4 ? kInt64 : kInt32)
+                                                    : (sizeof(T) > 4 ? kUint64 : kUint32);
+    }
+
+    template <typename T>
+    static size_t copy(char *record, size_t pos, const T &value)
+    {
+        if (pos + sizeof(T) > static_cast<size_t>(kMaxRecordSize))
+        {
+            return pos;
+        }
+        memcpy(record + pos, &value, sizeof(T));
+        return pos + sizeof(T);
+    }
+
+    static size_t encodeString(char *record, size_t pos, const char *str, size_t len)
+    {
+        if (pos + sizeof(uint32_t) > static_cast<size_t>(kMaxRecordSize))
+        {
+            return pos;
+        }
+        size_t room = kMaxRecordSize - pos - sizeof(uint32_t);
+        uint32_t stored = static_cast<uint32_t>(len < room ? len : room);
+        memcpy(record + pos, &stored, sizeof(stored));
+        memcpy(record + pos + sizeof(stored), str, stored);
+        return pos + sizeof(stored) + stored;
+    }
+
+    static size_t encode(char *record, size_t pos, const std::string &value) { return encodeString(record, pos, value.data(), value.size()); }
+    static size_t encode(char *record, size_t pos, const char *value)
+    {
+        return value ? encodeString(record, pos, value, strlen(value)) : encodeString(record, pos, "(null)", 6);
+    }
+    static size_t encode(char *record, size_t pos, char *value) { return encode(record, pos, static_cast<const char *>(value)); }
+
+    template <typename T>
+    static size_t encode(char *record, size_t pos, const T &value)
+    {
+        constexpr char type = typeOf<T>();
+        if constexpr (type == kPointer)
+        {
+            return copy(record, pos, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value)));
+        }
+        else if constexpr (type == kDouble)
+        {
+            return copy(record, pos, static_cast<double>(value));
+        }
+        else if constexpr (type == kInt32)
+        {
+            return copy(record, pos, static_cast<int32_t>(value));
+        }
+        else if constexpr (type == kUint32)
+        {
+            return copy(record, pos, static_cast<uint32_t>(value));
+        }
+        else if constexpr (type == kInt64)
+        {
+            return copy(record, pos, static_cast<int64_t>(value));
+        }
+        else
+        {
+            return copy(record, pos, static_cast<uint64_t>(value));
+        }
+    }
+};
+
+/**
+ * 与LOG_XXX相同的等级检查, 关闭的语句不会对参数求值
+ * 格式编号保存在调用处的静态变量中, 参数类型由decltype得到, 也不会对参数求值
+ */
+#define RAIN_LOGB(level, fmt, ...)                                                                                    \
+    do                                                                                                                \
+    {                                                                                                                 \
+        if ((level) >= RAIN_LOG_MIN_LEVEL && ((level) == Logger::FATAL || Logger::enabled((level), Logger::RAIN_LOG_MODULE))) \
+        {                                                                                                             \
+            static const uint32_t rainLogFormatId = BinaryLog::registerFormat(                                        \
+                (level), __FILE__, __LINE__, fmt, decltype(BinaryLog::argTypesOf(__VA_ARGS__))::get());               \
+            BinaryLog::write(rainLogFormatId, (level), ##__VA_ARGS__);                                                \
+        }                                                                                                             \
+    } while (0)
+
+#define LOGB_TRACE(fmt, ...) RAIN_LOGB(Logger::TRACE, fmt, ##__VA_ARGS__)
+#define LOGB_DEBUG(fmt, ...) RAIN_LOGB(Logger::DEBUG, fmt, ##__VA_ARGS__)
+#define LOGB_INFO(fmt, ...) RAIN_LOGB(Logger::INFO, fmt, ##__VA_ARGS__)
+#define LOGB_WARN(fmt, ...) RAIN_LOGB(Logger::WARN, fmt, ##__VA_ARGS__)
+#define LOGB_ERROR(fmt, ...) RAIN_LOGB(Logger::ERROR, fmt, ##__VA_ARGS__)
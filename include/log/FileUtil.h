@@ -1,23 +1,49 @@
 #pragma once
 #include<string>
-#include<stdio.h>
+#include<stdint.h>
 #include<sys/types.h>//off_t
+#include "Noncopyable.h"
 /**
  * @brief 文件工具类，用于处理文件的写入操作
- * 该类封装了对文件的基本操作，包括写入数据和刷新缓冲区
+ * 数据先写入本对象的对齐缓冲区，写满或flush()时用pwrite按文件偏移整块写入
+ * 可以预分配文件空间、使用O_DIRECT绕过页缓存，并按策略调用fdatasync把数据落盘
  */
-class FileUtil
+class FileUtil : Noncopyable
 {
 public:
+    /**
+     * @brief fdatasync的时机，每次同步落盘的是之前所有已经写入的数据
+     */
+    enum SyncPolicy
+    {
+        kSyncNever,      // 不主动同步，由内核决定何时落盘
+        kSyncEveryBytes, // 每写入syncEvery字节同步一次
+        kSyncInterval,   // flush()时距上次同步超过syncEvery毫秒则同步
+    };
+
+    /**
+     * @brief 打开文件的选项
+     */
+    struct Options
+    {
+        Options() : preallocate(0), directIO(false), syncPolicy(kSyncNever), syncEvery(0) {}
+
+        off_t preallocate;     // 打开后用fallocate预分配的字节数，不改变文件长度，0表示不预分配
+        bool directIO;         // 使用O_DIRECT写入，文件系统不支持时自动退回普通写入
+        SyncPolicy syncPolicy;
+        int64_t syncEvery;     // kSyncEveryBytes时为字节数，kSyncInterval时为毫秒数
+    };
+
     /**
      * @brief 构造函数
-     * @param file_name 要打开的文件名
+     * @param file_name 要打开的文件名，已经存在时接在文件末尾写入
+     * @param options 打开文件的选项
      */
-    FileUtil(std::string& file_name);
+    FileUtil(std::string& file_name, const Options& options = Options());
 
     /**
      * @brief 析构函数
-     * 负责关闭文件和清理资源
+     * 写入缓冲区中剩余的数据，按策略同步后关闭文件，释放未用完的预分配空间
      */
     ~FileUtil();
 
@@ -30,7 +56,7 @@ public:
 
     /**
      * @brief 刷新文件缓冲区
-     * 将缓冲区中的数据立即写入文件
+     * 将缓冲区中的数据立即写入文件，并检查是否需要同步落盘
      */
     void flush();
 
@@ -38,11 +64,37 @@ public:
      * @brief 获取已写入的字节数
      * @return 返回已写入文件的总字节数
      */
-    off_t writtenBytes() const { return writtenBytes_; }  
+    off_t writtenBytes() const { return writtenBytes_; }
 
 private:
-    size_t write(const char* data, size_t len);
-    FILE* file_;                  // 文件指针，用于操作文件
-    char buffer_[64*1024];       // 文件操作的缓冲区，大小为64KB，用于提高写入效率
+    // O_DIRECT要求的文件偏移、长度和内存地址对齐
+    static const size_t kAlignment = 4096;
+    // 缓冲区大小，也是一次pwrite的最大长度
+    static const size_t kBufferSize = 256 * 1024;
+
+    // 写出缓冲区，O_DIRECT时不足一个对齐块的尾部留在缓冲区，由tailFd_写入
+    void writeBuffer();
+    // O_DIRECT时通过tailFd_写入缓冲区中不足一个对齐块的尾部
+    void writeTail();
+    // 在offset处写入len字节，失败时输出错误并返回false
+    bool writeAt(int fd, const char* data, size_t len, off_t offset);
+    // 按syncPolicy决定是否调用fdatasync，interval为true时检查时间间隔
+    void maybeSync(bool interval);
+    void sync();
+    // O_DIRECT写入不可用时改为普通写入
+    void disableDirectIO();
+
+    int fd_;                     // 写入用的文件描述符，directIO_时带O_DIRECT
+    int tailFd_;                 // directIO_时写入不对齐的尾部，否则为-1
+    bool directIO_;
+    off_t preallocated_;         // 预分配到的文件偏移，关闭时释放之后的部分
+    const SyncPolicy syncPolicy_;
+    const int64_t syncEvery_;
+    char* buffer_;               // 对齐的写缓冲区，大小kBufferSize
+    size_t bufferLen_;           // 缓冲区中的字节数
+    off_t bufferOffset_;         // 缓冲区开头对应的文件偏移
+    off_t unsyncedBytes_;        // 上次同步之后写入的新字节数
+    size_t tailCounted_;         // 缓冲区开头已由尾部写入计入unsyncedBytes_的字节数, 再次写入时不重复计数
+    int64_t lastSyncMs_;         // 上次同步的时间(毫秒，单调时钟)
     off_t writtenBytes_;        // 记录已写入文件的总字节数，off_t类型用于大文件支持
-};
\ No newline at end of file
+};
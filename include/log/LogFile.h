@@ -3,6 +3,8 @@
 #include <mutex>
 #include <memory>
 #include <ctime>
+#include <functional>
+#include <string>
 /**
  * @brief 日志文件管理类
  * 负责日志文件的创建、写入、滚动和刷新等操作
@@ -17,11 +19,15 @@ public:
      * @param rollsize 日志文件大小达到多少字节时滚动，单位:字节
      * @param flushInterval 日志刷新间隔时间，默认3秒
      * @param checkEveryN_ 写入checkEveryN_次后检查是否需要滚动，默认1024次
+     * @param suffix 日志文件名后缀，默认.log
+     * @param options 每个日志文件的写入选项(预分配、O_DIRECT、落盘策略)
      */
     LogFile(const std::string &basename,
             off_t rollsize,
             int flushInterval = 3,
-            int checkEveryN_ = 1024);
+            int checkEveryN_ = 1024,
+            const std::string &suffix = ".log",
+            const FileUtil::Options &options = FileUtil::Options());
     ~LogFile();
     /**
      * @brief 追加数据到日志文件
@@ -31,7 +37,14 @@ public:
     void append(const char *data,int len);
 
     /**
-     * @brief 强制将缓冲区数据刷新到磁盘
+     * @brief 设置文件头，每个新日志文件创建后先写入header()返回的内容
+     * 当前文件还没有写入数据时立即写入
+     */
+    void setFileHeader(const std::function<std::string()> &header);
+
+    /**
+     * @brief 强制将缓冲区数据写入文件，按落盘策略同步
+     * 同时更新缓存的时间，检查是否需要按时间滚动
      */
     void flush();
 
@@ -52,9 +65,9 @@ private:
      * @brief 生成日志文件名
      * @param basename 日志文件基本名称
      * @param now 当前时间指针
-     * @return 完整的日志文件名，格式为:basename.YYYYmmdd-HHMMSS.log
+     * @return 完整的日志文件名，格式为:basename.YYYYmmdd-HHMMSS+suffix
      */
-    static std::string getLogFileName(const std::string &basename, time_t *now);
+    static std::string getLogFileName(const std::string &basename, const std::string &suffix, time_t *now);
 
     /**
      * @brief 在已加锁的情况下追加数据
@@ -64,16 +77,20 @@ private:
     void appendInlock(const char *data, int len);
 
     const std::string basename_;
+    const std::string suffix_; // 文件名后缀
     const off_t rollsize_;    //滚动文件大小
     const int flushInterval_; // 冲刷时间限值，默认3s
     const int checkEveryN_;   // 写数据次数限制，默认1024
+    const FileUtil::Options options_; // 新建日志文件的选项
 
     int count_; // 写数据次数计数, 超过限值checkEveryN_时清除, 然后重新计数
 
     std::mutex mutex_;
+    time_t now_;// 缓存的当前时间(秒)，每checkEveryN_次写入、flush()和滚动时更新
     time_t startOfPeriod_;// 本次写log周期的起始时间(秒)
     time_t lastRoll_;// 上次roll日志文件时间(秒)
     time_t lastFlush_; // 上次flush日志文件时间(秒)
     std::unique_ptr<FileUtil> file_;
+    std::function<std::string()> header_; // 新文件的文件头
     const static int kRollPerSeconds_ = 60*60*24;
 };
@@ -5,12 +5,23 @@
 #include <string.h>
 #include <string>
 #include <errno.h>
+#include <atomic>
 #include "LogStream.h"
 #include<functional>
 #include "Timestamp.h"
 
 #define OPEN_LOGGING
 
+// 编译期最低日志等级(0:TRACE ... 5:FATAL), 低于它的LOG_XXX语句被编译器整体去掉, 由CMake的RAIN_LOG_MIN_LEVEL设置
+#ifndef RAIN_LOG_MIN_LEVEL
+#define RAIN_LOG_MIN_LEVEL 0
+#endif
+
+// 当前源文件所属的模块, 由各模块的CMakeLists设置, 用于按模块设置日志等级
+#ifndef RAIN_LOG_MODULE
+#define RAIN_LOG_MODULE kApp
+#endif
+
 // SourceFile的作用是提取文件名
 class SourceFile
 {
@@ -46,6 +57,16 @@ public:
         FATAL,
         LEVEL_COUNT,
     };
+    // 日志模块, 可以分别设置等级
+    enum LogModule
+    {
+        kApp,    // 用户代码
+        kNet,
+        kLog,
+        kMemory,
+        kUtil,
+        MODULE_COUNT,
+    };
     Logger(const char *filename, int line, LogLevel level);
     ~Logger();
     // 流是会改变的
@@ -57,6 +78,27 @@ public:
     using FlushFunc = std::function<void()>;
     static void setOutput(OutputFunc);
     static void setFlush(FlushFunc);
+    // 把格式化好的日志交给当前的输出函数, 给不经过Logger格式化的日志(如BinaryLog)使用
+    static void output(const char *data, int len);
+    // 日志等级的名字, 固定6个字符
+    static const char *levelName(LogLevel level);
+
+    // 全局日志等级(默认INFO), 没有单独设置等级的模块都使用它, 线程安全
+    static void setLogLevel(LogLevel level);
+    static LogLevel logLevel();
+    // 单独设置一个模块的日志等级, 线程安全
+    static void setModuleLogLevel(LogModule module, LogLevel level);
+    // 取消模块的单独设置, 恢复使用全局日志等级
+    static void resetModuleLogLevel(LogModule module);
+
+    // 从Logger输出的一行日志中取出日志等级, 不是Logger格式的行返回INFO
+    static LogLevel lineLevel(const char *line, int len);
+
+    // LOG_XXX在构造Logger之前调用, 只读一个原子变量
+    static bool enabled(LogLevel level, LogModule module)
+    {
+        return level >= s_moduleLevels_[module].load(std::memory_order_relaxed);
+    }
 
 private:
     class Impl
@@ -76,6 +118,10 @@ private:
 
 private:
     Impl impl_;
+
+    // 根据全局等级和模块单独设置的等级更新s_moduleLevels_, 调用者加锁
+    static void applyLevels();
+    static std::atomic<int> s_moduleLevels_[MODULE_COUNT]; // 各模块实际生效的等级
 };
 
 // 获取errno信息
@@ -83,12 +129,20 @@ const char* getErrnoMsg(int savedErrno);
 /**
  * 当日志等级小于对应等级才会输出
  * 比如设置等级为FATAL，则logLevel等级大于DEBUG和INFO，DEBUG和INFO等级的日志就不会输出
+ * 等级不够时在构造Logger之前就跳过, <<后面的表达式也不会求值; 低于RAIN_LOG_MIN_LEVEL的语句在编译期去掉
+ * FATAL总是输出
  */
 #ifdef OPEN_LOGGING
-#define LOG_DEBUG Logger(__FILE__, __LINE__, Logger::DEBUG).stream()
-#define LOG_INFO Logger(__FILE__, __LINE__, Logger::INFO).stream()
-#define LOG_WARN Logger(__FILE__, __LINE__, Logger::WARN).stream()
-#define LOG_ERROR Logger(__FILE__, __LINE__, Logger::ERROR).stream()
+#define RAIN_LOG_IF(level)                                                                  \
+    if ((level) < RAIN_LOG_MIN_LEVEL || !Logger::enabled((level), Logger::RAIN_LOG_MODULE)) \
+        ;                                                                                   \
+    else                                                                                    \
+        Logger(__FILE__, __LINE__, (level)).stream()
+#define LOG_TRACE RAIN_LOG_IF(Logger::TRACE)
+#define LOG_DEBUG RAIN_LOG_IF(Logger::DEBUG)
+#define LOG_INFO RAIN_LOG_IF(Logger::INFO)
+#define LOG_WARN RAIN_LOG_IF(Logger::WARN)
+#define LOG_ERROR RAIN_LOG_IF(Logger::ERROR)
 #define LOG_FATAL Logger(__FILE__, __LINE__, Logger::FATAL).stream()
 #else
 #define LOG(level) LogStream()
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <memory>
+
+#include "Noncopyable.h"
+
+// Single producer single consumer byte ring between one logging thread and the AsyncLogging backend
+// The producer appends whole log lines without lock or read-modify-write,
+// the backend reads them as at most two contiguous regions and releases them with consume()
+class StagingBuffer : Noncopyable
+{
+public:
+    // Capacity is rounded up to a power of two
+    explicit StagingBuffer(size_t capacity)
+        : capacity_(roundUp(capacity)),
+          mask_(capacity_ - 1),
+          data_(new char[capacity_]),
+          retired_(false),
+          head_(0),
+          cachedTail_(0),
+          writing_(false),
+          tail_(0)
+    {
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    // Producer: append header then data as one unit, the backend never sees a part of it
+    // Return false if there is not enough free space
+    bool append(const void *header, size_t headerLen, const void *data, size_t len)
+    {
+        const uint64_t head = head_.load(std::memory_order_relaxed);
+        const size_t total = headerLen + len;
+        if (capacity_ - (head - cachedTail_) < total)
+        {
+            // Only read the backend's position when the cached one says full
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+            if (capacity_ - (head - cachedTail_) < total)
+            {
+                return false;
+            }
+        }
+        copyIn(head, header, headerLen);
+        copyIn(head + headerLen, data, len);
+        head_.store(head + total, std::memory_order_release);
+        return true;
+    }
+
+    // Producer: at least half of the buffer is waiting for the backend
+    bool halfFull()
+    {
+        const uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head - cachedTail_ < capacity_ / 2)
+        {
+            return false;
+        }
+        cachedTail_ = tail_.load(std::memory_order_acquire);
+        return head - cachedTail_ >= capacity_ / 2;
+    }
+
+    // Bytes appended and not consumed yet, may be stale
+    size_t size() const
+    {
+        return static_cast<size_t>(head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire));
+    }
+
+    // Consumer: readable bytes as [first, first + firstLen) followed by [second, second + secondLen)
+    // Return firstLen + secondLen
+    size_t peek(const char **first, size_t *firstLen, const char **second, size_t *secondLen) const
+    {
+        const uint64_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t readable = static_cast<size_t>(head_.load(std::memory_order_acquire) - tail);
+        const size_t offset = static_cast<size_t>(tail & mask_);
+        *first = data_.get() + offset;
+        *firstLen = readable < capacity_ - offset ? readable : capacity_ - offset;
+        *second = data_.get();
+        *secondLen = readable - *firstLen;
+        return readable;
+    }
+
+    // Consumer: release len bytes returned by peek()
+    void consume(size_t len) { tail_.store(tail_.load(std::memory_order_relaxed) + len, std::memory_order_release); }
+
+    // Producer: an append is in progress, set before the producer checks that the backend still runs,
+    // so the backend either is seen stopping or waits for the append before its last drain
+    void beginWrite() { writing_.store(true); }
+    void endWrite() { writing_.store(false, std::memory_order_release); }
+    bool writing() const { return writing_.load(); }
+
+    // The producer thread exited, the backend drops the buffer once it is drained
+    void retire() { retired_.store(true, std::memory_order_release); }
+    bool retired() const { return retired_.load(std::memory_order_acquire); }
+
+private:
+    static size_t roundUp(size_t n)
+    {
+        size_t capacity = 4096;
+        while (capacity < n)
+        {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+    void copyIn(uint64_t position, const void *src, size_t len)
+    {
+        if (len == 0)
+        {
+            return;
+        }
+        const size_t offset = static_cast<size_t>(position & mask_);
+        const size_t firstLen = len < capacity_ - offset ? len : capacity_ - offset;
+        memcpy(data_.get() + offset, src, firstLen);
+        memcpy(data_.get(), static_cast<const char *>(src) + firstLen, len - firstLen);
+    }
+
+    const size_t capacity_;
+    const size_t mask_;
+    const std::unique_ptr<char[]> data_;
+    std::atomic<bool> retired_;
+
+    // Producer side
+    alignas(64) std::atomic<uint64_t> head_; // Total bytes appended
+    uint64_t cachedTail_;                    // Last tail_ seen by the producer
+    std::atomic<bool> writing_;              // Between beginWrite() and endWrite()
+
+    // Consumer side
+    alignas(64) std::atomic<uint64_t> tail_; // Total bytes consumed
+};
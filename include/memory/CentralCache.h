@@ -5,6 +5,7 @@
 #include <thread>
 
 #include "Common.h"
+#include "Numa.h"
 #include "PageCache.h"
 
 namespace RainMemoPool
@@ -12,10 +13,15 @@ namespace RainMemoPool
     class CentralCache
     {
     public:
+        // 每个NUMA节点一个实例, 第一次使用时创建, 线程只从所在节点的实例取内存
         static CentralCache &getInstance()
         {
-            static CentralCache instance;
-            return instance;
+            static std::once_flag once[Numa::MAX_NODES];
+            static CentralCache *instances[Numa::MAX_NODES];
+            int node = Numa::currentNode() % Numa::MAX_NODES;
+            std::call_once(once[node], [node]()
+                           { instances[node] = new CentralCache(); });
+            return *instances[node];
         }
 
         void *fetchRange(size_t index, size_t batchNum);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace RainMemoPool
+{
+    // NUMA拓扑和线程所在节点, 拓扑从/sys/devices/system/node读取, 不依赖libnuma
+    class Numa
+    {
+    public:
+        static const int MAX_NODES = 8; // 最多支持的节点数, 超出的节点按取模共用内存池
+
+        // 节点个数, 非NUMA机器或读取失败时为1
+        static int nodeCount();
+
+        // 节点上的CPU编号, 节点不存在时返回空
+        static std::vector<int> nodeCpus(int node);
+
+        // 当前线程使用的节点(内存池按节点分arena), 默认0
+        static int currentNode();
+        // 线程绑核后调用, 设置当前线程使用的节点
+        static void setCurrentNode(int node);
+
+        // 把[ptr, ptr + size)的页面优先分配在node上(mbind MPOL_PREFERRED), 单节点时什么都不做
+        static void bindMemory(void *ptr, size_t size, int node);
+    };
+
+} // namespace RainMemoPool
@@ -7,6 +7,7 @@
 #include <mutex>
 
 #include "Common.h"
+#include "Numa.h"
 
 namespace RainMemoPool
 {
@@ -16,10 +17,15 @@ namespace RainMemoPool
     public:
         static const size_t PAGE_SIZE = 4096; // 4K页大小
 
+        // 每个NUMA节点一个实例, 新申请的页面分配在该节点上, 第一次使用时创建
         static PageCache &getInstance()
         {
-            static PageCache instance;
-            return instance;
+            static std::once_flag once[Numa::MAX_NODES];
+            static PageCache *instances[Numa::MAX_NODES];
+            int node = Numa::currentNode() % Numa::MAX_NODES;
+            std::call_once(once[node], [node]()
+                           { instances[node] = new PageCache(node); });
+            return *instances[node];
         }
 
         // 分配指定页数的span
@@ -29,7 +35,7 @@ namespace RainMemoPool
         void deallocateSpan(void *ptr, size_t numPages);
 
     private:
-        PageCache() = default;
+        explicit PageCache(int node) : node_(node) {}
 
         // 向系统申请内存
         void *systemAlloc(size_t numPages);
@@ -47,6 +53,8 @@ namespace RainMemoPool
         // 页号到span的映射，用于回收
         std::map<void *, Span *> spanMap_;
         std::mutex mutex_;
+        // 所属的NUMA节点
+        const int node_;
     };
 
 } // namespace memoryPool
\ No newline at end of file
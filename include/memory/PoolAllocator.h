@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+#include "MemoryPool.h"
+
+namespace RainMemoPool
+{
+    // 从内存池分配的STL分配器, 用于std::allocate_shared等, 对象和控制块放在同一个内存池块中
+    // 内存来自当前线程的ThreadCache, 在其他线程释放时进入释放线程的缓存
+    template <typename T>
+    class PoolAllocator
+    {
+    public:
+        using value_type = T;
+
+        PoolAllocator() noexcept = default;
+        template <typename U>
+        PoolAllocator(const PoolAllocator<U> &) noexcept {}
+
+        T *allocate(size_t n)
+        {
+            static_assert(alignof(T) <= ALIGNMENT, "PoolAllocator only supports ALIGNMENT aligned types");
+            void *ptr = MemoryPool::allocate(n * sizeof(T));
+            if (!ptr)
+                throw std::bad_alloc();
+            return static_cast<T *>(ptr);
+        }
+
+        void deallocate(T *ptr, size_t n) noexcept
+        {
+            MemoryPool::deallocate(ptr, n * sizeof(T));
+        }
+
+        template <typename U>
+        bool operator==(const PoolAllocator<U> &) const noexcept { return true; }
+        template <typename U>
+        bool operator!=(const PoolAllocator<U> &) const noexcept { return false; }
+    };
+
+} // namespace RainMemoPool
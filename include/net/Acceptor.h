@@ -1,18 +1,23 @@
 #pragma once
 
 #include <functional>
+#include <utility>
+#include <vector>
 
 #include "Channel.h"
+#include "InetAddress.h"
 #include "Noncopyable.h"
 #include "Socket.h"
 
 class EventLoop;
-class InetAddress;
 
 class Acceptor : Noncopyable
 {
 public:
     using NewConnectionCallback = std::function<void(int sockfd, const InetAddress &)>;
+    using AcceptedList = std::vector<std::pair<int, InetAddress>>;
+    /// Connections accepted by one handleRead(), the callback owns the fds
+    using NewConnectionsCallback = std::function<void(const AcceptedList &)>;
 
     Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport);
     ~Acceptor();
@@ -22,11 +27,42 @@ public:
      */
     void setNewConnectionCallback(const NewConnectionCallback &cb) { NewConnectionCallback_ = cb; }
 
+    /**
+     * @brief Set new connections callback function, called once per event with all accepted connections
+     * @details Takes precedence over the per connection callback, lets the caller hand them off in batches.
+     */
+    void setNewConnectionsCallback(const NewConnectionsCallback &cb) { newConnectionsCallback_ = cb; }
+
+    /**
+     * @brief Max connections accepted per readiness event(default 16)
+     * @details Level triggered: the rest of the backlog wakes the loop again, so other channels are not starved.
+     *          Edge triggered: accept continues until EAGAIN, connections are handed off every acceptBatch.
+     */
+    void setAcceptBatch(int acceptBatch) { acceptBatch_ = acceptBatch > 0 ? acceptBatch : 1; }
+
+    /**
+     * @brief Listen options, must be set before listen()
+     * @param backlog listen() backlog, capped by net.core.somaxconn(default 1024)
+     * @param deferAcceptSeconds TCP_DEFER_ACCEPT: wake up only when data arrives, up to that many seconds, 0 disables
+     * @param fastOpenQueue TCP_FASTOPEN: max pending TFO requests, 0 disables
+     */
+    void setListenOptions(int backlog, int deferAcceptSeconds, int fastOpenQueue)
+    {
+        backlog_ = backlog;
+        deferAcceptSeconds_ = deferAcceptSeconds;
+        fastOpenQueue_ = fastOpenQueue;
+    }
+
     /**
      * @brief Judge whether the Acceptor is listening
      */
     bool listening() const { return listening_; }
 
+    /**
+     * @brief Register the listen socket with EPOLLET, accept until EAGAIN on each event
+     */
+    void setEdgeTriggered(bool on) { acceptChannel_.setEdgeTriggered(on); }
+
     /**
      * @brief Start listening local port
      */
@@ -38,9 +74,28 @@ private:
      */
     void handleRead();
 
+    /**
+     * @brief Out of fds: accept with the reserved fd and close at once, so the client sees a clean close
+     *        and the pending connection does not keep the listen socket readable
+     * @return false if there is no reserved fd
+     */
+    bool shedConnection();
+
+    /**
+     * @brief Hand accepted_ to the callbacks
+     */
+    void dispatchAccepted();
+
     EventLoop *loop_;                             ///< Acceptor use user-defined baseLoop, also mainLoop
     Socket acceptSocket_;                         ///< Accept new connection socket
     Channel acceptChannel_;                       ///< Use to listen connection
     NewConnectionCallback NewConnectionCallback_; ///< New connection callback
+    NewConnectionsCallback newConnectionsCallback_; ///< Batched new connection callback
     bool listening_;                              ///< is it listening now?
+    int acceptBatch_;                             ///< Max connections accepted per event
+    int backlog_;                                 ///< listen() backlog
+    int deferAcceptSeconds_;                      ///< TCP_DEFER_ACCEPT, 0 disables
+    int fastOpenQueue_;                           ///< TCP_FASTOPEN queue, 0 disables
+    int idleFd_;                                  ///< Reserved fd for shedConnection()
+    AcceptedList accepted_;                       ///< Connections accepted in this event, not handed off yet
 };
\ No newline at end of file
@@ -1,10 +1,14 @@
 #pragma once
 
 #include <stddef.h>
+#include <string.h>
+#include <sys/types.h>
 
 #include <algorithm>
 #include <string>
-#include <vector>
+#include <utility>
+
+#include "MemoryPool.h"
 
 class Buffer
 {
@@ -20,13 +24,38 @@ public:
      * by reserving kCheapPrepend bytes before the initial size data,
      * so that we can prepend some data before the initial size data if necessary.
      * (we can wrap the data with like TCP/UDP/HTTP header)
-     *
+     * The memory comes from RainMemoPool thread cache and is left uninitialized.
      */
     explicit Buffer(size_t initalSize = kInitialSize)
-        : buffer_(kCheapPrepend + initalSize), readerIndex_(kCheapPrepend), writerIndex_(kCheapPrepend)
+        : capacity_(roundCapacity(kCheapPrepend + initalSize)), buffer_(allocate(capacity_)), readerIndex_(kCheapPrepend), writerIndex_(kCheapPrepend)
     {
     }
 
+    ~Buffer() { deallocate(buffer_, capacity_); }
+
+    /**
+     * @brief Move constructor, steal the storage of rhs without allocating
+     * @details rhs is left with no storage and no readable or writable bytes,
+     *          still valid to append to (which allocates), retrieve from or destroy
+     */
+    Buffer(Buffer &&rhs) noexcept
+        : capacity_(rhs.capacity_), buffer_(rhs.buffer_), readerIndex_(rhs.readerIndex_), writerIndex_(rhs.writerIndex_)
+    {
+        rhs.capacity_ = kCheapPrepend;
+        rhs.buffer_ = nullptr;
+        rhs.readerIndex_ = rhs.writerIndex_ = kCheapPrepend;
+    }
+
+    Buffer &operator=(Buffer &&rhs) noexcept
+    {
+        Buffer tmp(std::move(rhs));
+        swap(tmp);
+        return *this;
+    }
+
+    Buffer(const Buffer &) = delete;
+    Buffer &operator=(const Buffer &) = delete;
+
     /**
      * @brief Return the number of bytes that can be read from the buffer(size)
      * @details It can caculate by the writeIndex_ and readIndex_,
@@ -41,7 +70,7 @@ public:
      *          buffer size means the total size of buffer,
      *          writeIndex means the position first byte where we can write data.
      */
-    size_t writableBytes() const { return buffer_.size() - writerIndex_; }
+    size_t writableBytes() const { return capacity_ - writerIndex_; }
 
     /**
      * @brief Return the number of bytes that can be prepend to the buffer(size)
@@ -50,6 +79,17 @@ public:
      */
     size_t prependableBytes() const { return readerIndex_; }
 
+    /**
+     * @brief Swap the content of two buffers without copying data
+     */
+    void swap(Buffer &rhs) noexcept
+    {
+        std::swap(capacity_, rhs.capacity_);
+        std::swap(buffer_, rhs.buffer_);
+        std::swap(readerIndex_, rhs.readerIndex_);
+        std::swap(writerIndex_, rhs.writerIndex_);
+    }
+
     /**
      * @brief Return buffer readable data start address(pointer)
      */
@@ -120,7 +160,7 @@ public:
     {
         ensureWritableBytes(len);
         /// Need start and end address of data, and start address of destination
-        std::copy(data, data + len, beginWrite());
+        ::memcpy(beginWrite(), data, len);
         writerIndex_ += len;
     }
 
@@ -153,17 +193,35 @@ private:
     /**
      * @brief Return the start address of buffer
      */
-    char *begin() { return &*buffer_.begin(); }
+    char *begin() { return buffer_; }
 
     /**
      * @brief Return the const start address of buffer
      */
-    const char *begin() const { return &*buffer_.begin(); }
+    const char *begin() const { return buffer_; }
+
+    /**
+     * @brief Round a capacity up to what the memory pool really hands out
+     * @details Pool size classes are ALIGNMENT(8) bytes apart up to MAX_BYTES, larger blocks come from malloc,
+     *          rounding up lets the buffer use the whole block instead of wasting the tail.
+     */
+    static size_t roundCapacity(size_t size) { return RainMemoPool::SizeClass::roundUp(size); }
+
+    static char *allocate(size_t size) { return static_cast<char *>(RainMemoPool::MemoryPool::allocate(size)); }
+
+    static void deallocate(char *ptr, size_t size)
+    {
+        if (ptr != nullptr) ///< A moved-from buffer has no storage
+        {
+            RainMemoPool::MemoryPool::deallocate(ptr, size);
+        }
+    }
 
     /**
      * @brief Expand the buffer to make space for len bytes data
      * @details If the left space of buffer is not enough to prepend len bytes data,
-     *          we will expand the buffer to make space.
+     *          we will expand the buffer to make space: at least double the capacity,
+     *          allocate an uninitialized block and copy only the readable data to its front.
      *          Else we will move the readable data to the front of buffer,
      *          and reset the readerIndex_ and writerIndex_ to kCheapPrepend.
      */
@@ -171,7 +229,18 @@ private:
     {
         if (writableBytes() + prependableBytes() < len + kCheapPrepend)
         {
-            buffer_.resize(writerIndex_ + len);
+            size_t readable = readableBytes();
+            size_t capacity = roundCapacity(std::max(capacity_ * 2, kCheapPrepend + readable + len));
+            char *buffer = allocate(capacity);
+            if (readable > 0)
+            {
+                ::memcpy(buffer + kCheapPrepend, peek(), readable);
+            }
+            deallocate(buffer_, capacity_);
+            buffer_ = buffer;
+            capacity_ = capacity;
+            readerIndex_ = kCheapPrepend;
+            writerIndex_ = readerIndex_ + readable;
         }
         else
         {
@@ -184,7 +253,8 @@ private:
         }
     }
 
-    std::vector<char> buffer_; ///< The buffer data
-    size_t readerIndex_;       ///< The position first byte where we can read data
-    size_t writerIndex_;       ///< The position first byte where we can write data
+    size_t capacity_;    ///< The buffer size
+    char *buffer_;       ///< The buffer data, allocated from RainMemoPool
+    size_t readerIndex_; ///< The position first byte where we can read data
+    size_t writerIndex_; ///< The position first byte where we can write data
 };
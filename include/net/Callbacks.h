@@ -12,6 +12,10 @@ using ConnectionCallback = std::function<void(const TcpConnectionPtr &)>;
 using CloseCallback = std::function<void(const TcpConnectionPtr &)>;
 using WriteCompleteCallback = std::function<void(const TcpConnectionPtr &)>;
 using HighWaterMarkCallback = std::function<void(const TcpConnectionPtr &, size_t)>;
+// TcpConnection::sendFile progress: bytes of the file sent so far, bytes requested
+using SendFileProgressCallback = std::function<void(const TcpConnectionPtr &, size_t, size_t)>;
+// TcpConnection::sendFile end: bytes of the file sent, 0 on success or errno
+using SendFileCompleteCallback = std::function<void(const TcpConnectionPtr &, size_t, int)>;
 
 using MessageCallback = std::function<void(const TcpConnectionPtr &,
                                            Buffer *,
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <deque>
+#include <memory>
+
+#include "Noncopyable.h"
+
+/**
+ * @brief Output buffer made of a chain of chunks, flushed with writev
+ * @details Copied data goes into fixed size blocks allocated from RainMemoPool,
+ *          a full block is never moved or reallocated, a new block is linked after it.
+ *          External slices(memory owned by the caller) are linked without copying,
+ *          the owner is kept alive until the slice has been written.
+ *          Unlike Buffer, appending never copies data already in the buffer,
+ *          so large streamed responses cost no reallocation or memmove.
+ */
+class ChainBuffer : Noncopyable
+{
+public:
+    /// Size of a pool block, blocks are only used for copied data
+    static const size_t kBlockSize = 8 * 1024;
+
+    ChainBuffer();
+    ~ChainBuffer();
+
+    /**
+     * @brief Return the number of bytes not written yet
+     */
+    size_t readableBytes() const { return readable_; }
+
+    /**
+     * @brief Copy len bytes into the tail block, link new blocks if it is full
+     */
+    void append(const char *data, size_t len);
+
+    /**
+     * @brief Link len bytes at data without copying
+     * @param owner Keep data alive until it is retrieved, may be nullptr if data is static
+     */
+    void appendExternal(const char *data, size_t len, std::shared_ptr<const void> owner);
+
+    /**
+     * @brief Drop len bytes from the front, free the chunks that are fully consumed
+     */
+    void retrieve(size_t len);
+
+    /**
+     * @brief Drop all data and free all chunks
+     */
+    void retrieveAll();
+
+    /**
+     * @brief Swap the content of two buffers without copying data
+     */
+    void swap(ChainBuffer &rhs);
+
+    /**
+     * @brief Fill iov with the readable chunks from the front
+     * @return Number of iovec filled, at most maxIov
+     */
+    int fillIovec(struct iovec *iov, int maxIov) const;
+
+    /**
+     * @brief Return the owner of the front chunk, empty if it is a pool block or the buffer is empty
+     * @details Lets the caller send an external slice with MSG_ZEROCOPY and pin it by its owner.
+     */
+    const std::shared_ptr<const void> &frontOwner() const;
+
+    /**
+     * @brief Send at most maxBytes to fd with one writev of up to IOV_MAX chunks
+     * @details Like Buffer::writeFd, the caller retrieves the written bytes.
+     */
+    ssize_t writeFd(int fd, int *saveErrno, size_t maxBytes = static_cast<size_t>(-1)) const;
+
+private:
+    struct Chunk
+    {
+        char *block;                       ///< Pool block owned by the chain, nullptr for external slice
+        const char *data;                  ///< Start address of the chunk memory
+        size_t readIndex;                  ///< First byte not written yet
+        size_t writeIndex;                 ///< End of valid data, == length for external slice
+        std::shared_ptr<const void> owner; ///< Keep external slice alive
+    };
+
+    /**
+     * @brief Give the chunk memory back to the pool, or release the external owner
+     */
+    static void release(Chunk &chunk);
+
+    std::deque<Chunk> chunks_;
+    size_t readable_; ///< Sum of readable bytes of all chunks
+};
@@ -34,7 +34,7 @@ public:
     void tie(const std::shared_ptr<void> &);
 
     int fd() const { return fd_; }
-    int events() const { return events_; }
+    int events() const { return edgeTriggered_ ? events_ | kEdgeTriggered : events_; }
     void set_revents(int revt) { revents_ = revt; }
 
     // Set fd event status, which is equivalent to epoll_ctl add delete
@@ -64,8 +64,20 @@ public:
         update();
     }
 
+    // Register events with EPOLLET, handlers must drain fd until EAGAIN
+    // Takes effect immediately if channel is already in poller
+    void setEdgeTriggered(bool on)
+    {
+        edgeTriggered_ = on;
+        if (!isNoneEvent())
+        {
+            update();
+        }
+    }
+
     // Return current event status of fd
     bool isNoneEvent() const { return events_ == kNoneEvent; }
+    bool isEdgeTriggered() const { return edgeTriggered_; }
     bool isWriting() const { return events_ & kWriteEvent; }
     bool isReading() const { return events_ & kReadEvent; }
 
@@ -83,6 +95,7 @@ private:
     static const int kNoneEvent;
     static const int kReadEvent;
     static const int kWriteEvent;
+    static const int kEdgeTriggered;
 
     EventLoop *loop_;
 
@@ -90,6 +103,7 @@ private:
     int events_;   // Register fd event
     int revents_;  // Poller return specific event
     int index_;
+    bool edgeTriggered_; // Register events with EPOLLET
 
     std::weak_ptr<void> tie_;
     bool tied_;
@@ -3,16 +3,19 @@
 #include <atomic>
 #include <functional>
 #include <memory>
-#include <mutex>
 #include <vector>
 
 #include "CurrentThread.h"
+#include "MpscQueue.h"
+#include "TimerId.h"
 #include "TimerQueue.h"
 #include "Timestamp.h"
 #include "Noncopyable.h"
 
 class Channel;
+class IoUringPoller;
 class Poller;
+class ZeroCopyLinger;
 
 /**
  * @brief The heart of the server: Contain 2 modules: Channel and Poller(epoll)
@@ -23,6 +26,15 @@ public:
     /// Function object data structure
     using Functor = std::function<void()>;
 
+    /// Busy poll counters, see setBusyPoll()
+    struct BusyPollStats
+    {
+        uint64_t spinPolls;     ///< Polls with zero timeout
+        uint64_t spinHits;      ///< Zero timeout polls that returned events
+        uint64_t blockingPolls; ///< Polls that could block
+        uint64_t fallbacks;     ///< Times the spin budget ran out and the loop went back to blocking
+    };
+
     EventLoop();
     ~EventLoop();
 
@@ -33,6 +45,7 @@ public:
      *          3. Call poller_->poll() to get activeChannels_
      *          4. Update pollRetureTime_ to current time point
      *          5. Call doPendingFunctors() to execute pending callback functions
+     *          6. After quit, run the functors queued since the last iteration and set exited_
      */
     void loop();
 
@@ -52,6 +65,20 @@ public:
      */
     Timestamp pollReturnTime() const { return pollRetureTime_; }
 
+    /**
+     * @brief Low latency mode: keep polling with zero timeout for spinMicroSeconds after the last event
+     * @details While events keep coming the loop never sleeps in the kernel, so it does not pay the wakeup latency
+     *          of a blocking epoll_wait. With no event for spinMicroSeconds it falls back to blocking polls.
+     *          Burns a cpu while spinning, best with pinned loop threads. 0 disables(default).
+     *          Call before loop() or in the loop thread.
+     */
+    void setBusyPoll(int64_t spinMicroSeconds) { busyPollMicroSeconds_ = spinMicroSeconds; }
+
+    /**
+     * @brief Busy poll counters, thread safe
+     */
+    BusyPollStats busyPollStats() const;
+
     /**
      * @brief Run a callback function in the loop thread
      * @details If the current thread is the loop thread, the callback function is executed directly.
@@ -59,16 +86,24 @@ public:
      */
     void runInLoop(Functor cb);
 
+    /**
+     * @brief Run a batch of callback functions in the loop thread
+     * @details Same as calling runInLoop() for each one in order, but other threads wake up the loop only once.
+     */
+    void runInLoopBatch(std::vector<Functor> &&cbs);
+
     /**
      * @brief Queue a callback function to be executed in the loop thread
-     * @details 1. Put callback function into the pending callback functions container
-     *          2. If the current thread is the loop thread, call doPendingFunctors() to execute the callback function.
+     * @details 1. Push callback function into the lock-free pending functors queue
+     *          2. Wake up the loop thread if called from other threads or while the loop is calling pending functors
+     * @note Thread safe, callbacks are executed in the order they are queued
      */
     void queueInLoop(Functor cb);
 
     /**
      * @brief Wake up the loop thread
-     * @details Write a byte to the wakeupFd_ to wake up the loop thread blocked in epoll_wait
+     * @details Write 8 bytes to the wakeupFd_ to wake up the loop thread blocked in epoll_wait.
+     *          Only the first caller after the loop consumed the last wakeup writes, others see wakeupPending_ and return.
      */
     void wakeup();
 
@@ -93,30 +128,71 @@ public:
      */
     bool isInLoopThread() const { return threadId_ == CurrentThread::tid(); }
 
+    /**
+     * @brief Check if loop() has returned
+     * @details False until loop() finished its final doPendingFunctors(), so it stays false before loop()
+     *          starts. Once it returns true the loop runs no more functors: a functor queued from another
+     *          thread that has not run by then never runs.
+     */
+    bool hasExited() const { return exited_; }
+
+    /**
+     * @brief Return the io_uring poller of this loop, nullptr if the loop polls with epoll
+     * @details TcpConnection use it to run completion based recv/send.
+     */
+    IoUringPoller *ioUringPoller() const { return ioUringPoller_; }
+
+    /**
+     * @brief Return the pipe used by the connections of this loop to splice non regular files into sockets
+     * @details Created on first use and shared by all connections of the loop,
+     *          a caller must leave it empty before returning to the loop.
+     * @return false if the pipe can not be created
+     */
+    bool splicePipe(int *readFd, int *writeFd);
+
+    /**
+     * @brief Return the holder of MSG_ZEROCOPY payloads left by destroyed connections of this loop
+     * @details Created on first use, call in the loop thread only.
+     */
+    ZeroCopyLinger *zeroCopyLinger();
+
     /**
      * @brief Schedule a callback function to be executed at a specific time point
+     * @return Handle for cancel()
      */
-    void runAt(Timestamp timestamp, Functor &&cb)
+    TimerId runAt(Timestamp timestamp, Functor &&cb)
     {
-        timerQueue_->addTimer(std::move(cb), timestamp, 0.0);
+        return timerQueue_->addTimer(std::move(cb), timestamp, 0.0);
     }
 
     /**
      * @brief Schedule a callback function to be executed after a specific time interval
+     * @return Handle for cancel()
      */
-    void runAfter(double waitTime, Functor &&cb)
+    TimerId runAfter(double waitTime, Functor &&cb)
     {
         Timestamp time(addTime(Timestamp::now(), waitTime));
-        runAt(time, std::move(cb));
+        return runAt(time, std::move(cb));
     }
 
     /**
      * @brief Schedule a callback function to be executed every specific time interval
+     * @return Handle for cancel()
      */
-    void runEvery(double interval, Functor &&cb)
+    TimerId runEvery(double interval, Functor &&cb)
     {
         Timestamp timestamp(addTime(Timestamp::now(), interval));
-        timerQueue_->addTimer(std::move(cb), timestamp, interval);
+        return timerQueue_->addTimer(std::move(cb), timestamp, interval);
+    }
+
+    /**
+     * @brief Cancel a timer, thread safe
+     * @details The callback is released without being called. Timers already fired or cancelled are ignored,
+     *          a callback may cancel other timers of the same expiry batch or its own repeating timer.
+     */
+    void cancel(TimerId timerId)
+    {
+        timerQueue_->cancel(timerId);
     }
 
 private:
@@ -134,14 +210,26 @@ private:
 
     std::atomic_bool looping_;
     std::atomic_bool quit_;
+    std::atomic_bool exited_; ///< Set once loop() returned and ran its final functors
 
     /// Record current EventLoop created by which thread
     const pid_t threadId_;
 
     /// Poller return Event Channels time point
     Timestamp pollRetureTime_;
+
+    /// Busy poll state, see setBusyPoll()
+    int64_t busyPollMicroSeconds_;
+    Timestamp lastActiveTime_; ///< Last poll that returned events
+    bool spinning_;            ///< Last poll was a zero timeout poll
+    std::atomic<uint64_t> spinPolls_;
+    std::atomic<uint64_t> spinHits_;
+    std::atomic<uint64_t> blockingPolls_;
+    std::atomic<uint64_t> fallbacks_;
     std::unique_ptr<Poller> poller_;
+    IoUringPoller *ioUringPoller_; ///< Same object as poller_ if it is an IoUringPoller, else nullptr
     std::unique_ptr<TimerQueue> timerQueue_;
+    std::unique_ptr<ZeroCopyLinger> zeroCopyLinger_; ///< nullptr until first use
 
     /**
      * When mainLoop get new Channel,
@@ -151,15 +239,18 @@ private:
     int wakeupFd_;
     std::unique_ptr<Channel> wakeupChannel_;
 
+    /// A wakeup has been written to wakeupFd_ and not read by the loop yet
+    std::atomic_bool wakeupPending_;
+
+    /// Pipe for TcpConnection::sendFile splice, {-1, -1} until first use
+    int splicePipe_[2];
+
     /// Return all active channels(events happened)
     ChannelList activeChannels_;
 
     /// Is current loop executing callback functions?
     std::atomic_bool callingPendingFunctors_;
 
-    /// Save pending callback functions
-    std::vector<Functor> pendingFunctors_;
-
-    /// Lock protect the vector container
-    std::mutex mutex_;
+    /// Save pending callback functions, pushed by any thread without lock, popped by loop thread only
+    MpscQueue<Functor> pendingFunctors_;
 };
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <functional>
 #include <mutex>
 #include <string>
+#include <vector>
 
 #include "Noncopyable.h"
 #include "Thread.h"
@@ -26,6 +27,11 @@ public:
      */
     EventLoop *startLoop();
 
+    /**
+     * @brief Pin the loop thread to cpus, must be called before startLoop()
+     */
+    void setCpuAffinity(const std::vector<int> &cpus) { thread_.setCpuAffinity(cpus); }
+
 private:
     /**
      * @brief The function that will be run in the new thread.
@@ -1,11 +1,15 @@
 #pragma once
 
+#include <stdint.h>
+
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include "ConsistenHash.h"
+#include "InetAddress.h"
 #include "Noncopyable.h"
 
 class EventLoop;
@@ -19,6 +23,27 @@ class EventLoopThreadPool : Noncopyable
 public:
     using ThreadInitCallback = std::function<void(EventLoop *)>;
 
+    /**
+     * @brief How getNextLoop() picks a sub loop for a new connection
+     */
+    enum Selection
+    {
+        kRoundRobin,        ///< Next loop in turn(default)
+        kLeastConnections,  ///< Loop with the fewest live connections
+        kPowerOfTwoChoices, ///< Fewer live connections of two random loops, near least-connections without a full scan
+        kIpAffinity,        ///< Consistent hash of the key(peer ip), the same client always lands on the same loop
+        kBoundedIpAffinity, ///< kIpAffinity, but a loop with more than capacityFactor times the average connections spills over
+        kCustom,            ///< User selector set with setSelector()
+    };
+
+    /**
+     * @brief User selection policy
+     * @param key Peer ip of the new connection
+     * @param loads Live connections of each loop
+     * @return Index of the loop, taken modulo the number of loops
+     */
+    using LoopSelector = std::function<size_t(const std::string &key, const std::vector<int> &loads)>;
+
     EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg);
     ~EventLoopThreadPool();
 
@@ -29,6 +54,39 @@ public:
      */
     void setThreadNum(int numThreads) { numThreads_ = numThreads; }
 
+    /**
+     * @brief Pin sub loop threads to cpus, must be called before start()
+     * @details Thread i runs on threadCpus[i % threadCpus.size()], empty(default) means no pinning.
+     *          A thread's memory pool arena is the one of the NUMA node it runs on.
+     */
+    void setThreadCpus(const std::vector<std::vector<int>> &threadCpus) { threadCpus_ = threadCpus; }
+
+    /**
+     * @brief Spread sub loop threads over NUMA nodes, must be called before start()
+     * @details Thread i is pinned to the cpus of node i % nodes, so it does not migrate across sockets and
+     *          its EventLoop, memory pool arena and buffers are allocated on that node. Ignored if setThreadCpus() is set.
+     */
+    void setNumaPlacement(bool on) { numaPlacement_ = on; }
+
+    /**
+     * @brief Set the loop selection policy, can be changed at any time from the base loop thread
+     * @param capacityFactor Only used by kBoundedIpAffinity, >= 1
+     */
+    void setSelection(Selection selection, double capacityFactor = 1.25)
+    {
+        selection_ = selection;
+        capacityFactor_ = capacityFactor;
+    }
+
+    /**
+     * @brief Use a user selection policy, switch to kCustom
+     */
+    void setSelector(const LoopSelector &selector)
+    {
+        selector_ = selector;
+        selection_ = kCustom;
+    }
+
     /**
      * @brief Start a Thread in the thread pool.
      *
@@ -38,9 +96,22 @@ public:
 
     /**
      * @brief Get the next EventLoop in the thread pool.
-     * @details Get the hash node by key, and return the EventLoop object.
+     * @details Pick a loop by the selection policy and count one more live connection on it,
+     *          return baseLoop_ if the pool has no thread.
+     * @param peerAddr Peer address, its ip is the key of kIpAffinity, kBoundedIpAffinity and kCustom,
+     *                 the other policies do not format it
+     */
+    EventLoop *getNextLoop(const InetAddress &peerAddr);
+
+    /**
+     * @brief A connection given by getNextLoop() is closed, count one less live connection on loop
+     */
+    void releaseLoop(EventLoop *loop);
+
+    /**
+     * @brief Live connections of each loop, in the order of getAllLoops()
      */
-    EventLoop *getNextLoop(const std::string &key);
+    std::vector<int> loads() const;
 
     /**
      * @brief Get all EventLoop in the thread pool.
@@ -66,5 +137,12 @@ private:
     int next_;                                              ///< New connection come, select EventLoop index
     std::vector<std::unique_ptr<EventLoopThread>> threads_; ///< IO thread list
     std::vector<EventLoop *> loops_;                        ///< Thread pool's EventLoop list, point to EventLoopThread function create EventLoop object
-    ConsistentHash hash_;                                   ///< Consistent Hash object
+    std::vector<std::vector<int>> threadCpus_;              ///< Cpus of each thread, empty means no pinning
+    bool numaPlacement_;                                    ///< Pin thread i to NUMA node i % nodes
+    Selection selection_;                                   ///< Loop selection policy
+    double capacityFactor_;                                 ///< Max connections of a loop over the average for kBoundedIpAffinity
+    ConsistentHash hash_;                                   ///< Maglev hash of the thread names, node index is the loop index
+    LoopSelector selector_;                                 ///< User policy for kCustom
+    std::unique_ptr<std::atomic<int>[]> loads_;             ///< Live connections per loop, read by any thread
+    uint32_t random_;                                       ///< xorshift state for kPowerOfTwoChoices
 };
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <linux/io_uring.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Noncopyable.h"
+
+/**
+ * @brief Thin wrapper of a raw io_uring instance (no liburing dependency)
+ * @details Owns the ring fd and the mmap-ed SQ/CQ rings, and exposes the few operations
+ *          the Poller needs: get a free SQE, submit (optionally waiting for completions
+ *          with a timeout), and walk the completion queue.
+ * @note Not thread safe, one IoUring belongs to one EventLoop thread.
+ */
+class IoUring : Noncopyable
+{
+public:
+    explicit IoUring(unsigned entries);
+    ~IoUring();
+
+    /**
+     * @brief Check whether the ring has been set up successfully
+     * @details io_uring may be disabled by the kernel or a seccomp filter, caller should fall back to epoll.
+     */
+    bool valid() const { return ringFd_ >= 0; }
+
+    int fd() const { return ringFd_; }
+
+    /**
+     * @brief Get a free submission queue entry, zero-initialized
+     * @details If the submission queue is full, submit the queued entries first to make space.
+     */
+    io_uring_sqe *getSqe();
+
+    /**
+     * @brief Number of SQEs queued by getSqe() but not submitted to the kernel yet
+     */
+    unsigned pendingSubmissions() const { return sqeTail_ - submitted_; }
+
+    /**
+     * @brief Submit all queued SQEs without waiting
+     * @return Number of SQEs consumed by the kernel, or -errno
+     */
+    int submit();
+
+    /**
+     * @brief Submit all queued SQEs and wait for at least waitNr completions
+     * @param timeoutMs Wait at most timeoutMs milliseconds, negative value means wait forever
+     * @return Number of SQEs consumed by the kernel, or -errno(-ETIME on timeout)
+     */
+    int submitAndWait(unsigned waitNr, int timeoutMs);
+
+    /**
+     * @brief Return the oldest unseen completion queue entry, nullptr if CQ is empty
+     */
+    io_uring_cqe *peekCqe();
+
+    /**
+     * @brief Mark the entry returned by peekCqe() as consumed
+     */
+    void cqeSeen();
+
+    /**
+     * @brief Thin wrapper of io_uring_register(2)
+     */
+    int registerOp(unsigned opcode, const void *arg, unsigned nrArgs);
+
+private:
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags, const void *arg, size_t argSize);
+
+    int ringFd_;
+    unsigned features_;
+
+    /// Submission queue ring
+    void *sqRingPtr_;
+    size_t sqRingSize_;
+    unsigned *sqHead_;
+    unsigned *sqTail_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    io_uring_sqe *sqes_;
+    size_t sqesSize_;
+    unsigned sqeTail_;   ///< Local tail, published to *sqTail_ when submitted
+    unsigned submitted_; ///< Local tail value last published to the kernel
+
+    /// Completion queue ring
+    void *cqRingPtr_;
+    size_t cqRingSize_;
+    unsigned *cqHead_;
+    unsigned *cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe *cqes_;
+};
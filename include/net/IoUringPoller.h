@@ -0,0 +1,162 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "IoUring.h"
+#include "Poller.h"
+#include "Timestamp.h"
+
+class Channel;
+
+/**
+ * Usage of io_uring as a readiness Poller:
+ * 1. IORING_OP_POLL_ADD per channel, queued into the SQ ring (no syscall)
+ * 2. IORING_OP_POLL_REMOVE + POLL_ADD when channel events change (no syscall)
+ * 3. One io_uring_enter per loop iteration submits all queued SQEs and waits for completions
+ *
+ * Level-triggered channels are armed with one-shot polls and re-armed after dispatch,
+ * since io_uring multishot poll only fires on new wakeups (edge-triggered).
+ * Channels whose events contain EPOLLET are armed once with multishot poll.
+ *
+ * Besides readiness, the poller runs completion based operations(recv/send...) for TcpConnection,
+ * their callbacks are called inside poll() when the CQE is harvested.
+ **/
+class IoUringPoller : public Poller
+{
+public:
+    /// Completion callback: res is cqe->res(bytes or -errno), flags is cqe->flags
+    using CompletionCallback = std::function<void(int res, unsigned flags)>;
+
+    IoUringPoller(EventLoop *loop);
+    ~IoUringPoller() override;
+
+    /**
+     * @brief Check whether io_uring is usable on this system
+     */
+    bool valid() const { return ring_.valid(); }
+
+    /**
+     * @brief Poll IO events, return the active channels
+     * @details 1. Queue re-arm SQEs for one-shot polls that fired last iteration
+     *          2. Harvest completions already in CQ ring without syscall
+     *          3. If nothing is ready, submit queued SQEs and wait in a single io_uring_enter()
+     *             else only submit queued SQEs(re-arms, sends) without waiting
+     *          4. Return the current timestamp
+     */
+    Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
+
+    /**
+     * @brief Update the channel
+     * @details Same index state machine as EPollPoller(kNew/kAdded/kDeleted),
+     *          but add/mod/del are queued as SQEs instead of epoll_ctl() syscalls.
+     */
+    void updateChannel(Channel *channel) override;
+
+    /**
+     * @brief Remove the channel
+     * @details Erase the channel from the map and queue a POLL_REMOVE for its poll request
+     */
+    void removeChannel(Channel *channel) override;
+
+    /**
+     * @brief Get a SQE for a completion based operation
+     * @details Caller fills opcode/fd/addr..., user_data is owned by the poller and must not be touched.
+     *          cb is called once per CQE in the loop thread, and released after the last CQE(no IORING_CQE_F_MORE).
+     * @param token Output, used to cancel the operation
+     */
+    io_uring_sqe *prepareOp(CompletionCallback cb, uint64_t *token);
+
+    /**
+     * @brief Cancel an in flight operation, its callback will get -ECANCELED
+     */
+    void cancelOp(uint64_t token);
+
+    /**
+     * @brief Set up the provided buffer ring of this loop on first use
+     * @details Buffers are published in a ring registered with IORING_REGISTER_PBUF_RING(Linux 5.19+),
+     *          recv ops with IOSQE_BUFFER_SELECT pick one when data arrives, so idle connections hold no memory.
+     * @return false if the kernel does not support buffer rings, the caller uses the readiness path
+     */
+    bool ensureProvidedBuffers();
+
+    /// Buffer group id to put into sqe->buf_group with IOSQE_BUFFER_SELECT
+    uint16_t bufferGroup() const { return kBufferGroup; }
+
+    /**
+     * @brief Return the start address of a provided buffer selected by kernel
+     */
+    const char *providedBuffer(uint16_t bid) const { return bufferBase_ + static_cast<size_t>(bid) * kProvidedBufferSize; }
+
+    /**
+     * @brief Give a provided buffer back to the kernel after its data has been consumed
+     * @details Written into the buffer ring and published by a tail store, no SQE or syscall
+     */
+    void recycleBuffer(uint16_t bid);
+
+private:
+    static const unsigned kRingEntries = 1024;
+    static const uint16_t kBufferGroup = 0;
+    static const unsigned kProvidedBufferCount = 128;        ///< Ring entries, must be a power of 2
+    static const size_t kProvidedBufferSize = 16 * 1024;     ///< 128 * 16KB = 2MB per loop
+    static const uint64_t kOpFlag = 1ULL << 63;              ///< user_data of completion ops, poll user_data never has it
+
+    /// Poll request state of one fd
+    struct PollRequest
+    {
+        uint32_t gen = 0;   ///< Generation of the armed request, encoded into user_data to filter stale completions
+        int events = 0;     ///< Events of the armed request
+        bool armed = false; ///< Is a poll request in flight in kernel
+        uint64_t round = 0; ///< Last poll() round the channel was reported active
+        int revents = 0;    ///< Events merged in the current round
+    };
+
+    /**
+     * @brief Harvest completions from the CQ ring
+     * @details Stale completions(cancelled or superseded request) are dropped by generation check.
+     *          Completion ops callbacks are called here.
+     * @return Number of completion ops callbacks called
+     */
+    int fillActiveChannels(ChannelList *activeChannels);
+
+    /**
+     * @brief Queue a POLL_ADD for channel with its current events
+     */
+    void arm(Channel *channel, PollRequest &request);
+
+    /**
+     * @brief Queue a POLL_REMOVE for the in flight request
+     */
+    void disarm(int fd, PollRequest &request);
+
+    io_uring_sqe *getSqe();
+
+    /**
+     * @brief Write a buffer into the ring at the local tail, published by the next tail store
+     */
+    void addBuffer(uint16_t bid);
+
+    static uint64_t encode(int fd, uint32_t gen) { return (static_cast<uint64_t>(fd) << 32) | gen; }
+
+    IoUring ring_;
+    uint32_t nextGen_;
+    uint64_t round_;
+
+    std::unordered_map<int, PollRequest> requests_;
+
+    /// One-shot polls completed last iteration, need to be re-armed
+    std::vector<int> rearmList_;
+
+    /// In flight completion operations, key is user_data token
+    uint64_t nextOpToken_;
+    std::unordered_map<uint64_t, CompletionCallback> ops_;
+
+    /// Provided buffers shared by all connections of this loop
+    char *bufferBase_;
+    io_uring_buf *bufferRing_; ///< Ring entries shared with the kernel
+    uint16_t *bufferTail_;     ///< Ring tail, overlaid on the resv field of the first entry
+    uint16_t localTail_;       ///< Tail value including entries not published yet
+};
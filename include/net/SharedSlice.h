@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+/**
+ * @brief Ref-counted immutable payload for TcpConnection::send
+ * @details Holds a view(data, size) and the owner that keeps the memory alive.
+ *          Copying a slice only copies the shared_ptr, so one payload can be queued by many
+ *          connections and moved across threads without copying the bytes.
+ *          The bytes must not be modified after the slice is created.
+ */
+class SharedSlice
+{
+public:
+    SharedSlice() : data_(nullptr), size_(0) {}
+
+    /**
+     * @brief Take ownership of a string, no copy of its content
+     */
+    explicit SharedSlice(std::string &&str)
+    {
+        std::shared_ptr<const std::string> holder = std::make_shared<const std::string>(std::move(str));
+        data_ = holder->data();
+        size_ = holder->size();
+        owner_ = std::move(holder);
+    }
+
+    /**
+     * @brief Reference memory kept alive by owner
+     */
+    SharedSlice(std::shared_ptr<const void> owner, const char *data, size_t size)
+        : owner_(std::move(owner)), data_(data), size_(size)
+    {
+    }
+
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const std::shared_ptr<const void> &owner() const { return owner_; }
+
+    /**
+     * @brief Return a sub slice sharing the same owner
+     */
+    SharedSlice slice(size_t offset, size_t len) const
+    {
+        offset = std::min(offset, size_);
+        return SharedSlice(owner_, data_ + offset, std::min(len, size_ - offset));
+    }
+
+private:
+    std::shared_ptr<const void> owner_;
+    const char *data_;
+    size_t size_;
+};
@@ -19,8 +19,8 @@ public:
     // Bind socket to local address
     void bindAddress(const InetAddress &localaddr);
 
-    // Start listening for incoming connections
-    void listen();
+    // Start listening for incoming connections, backlog is capped by net.core.somaxconn
+    void listen(int backlog = 1024);
 
     // Accept a client connection, return new socket fd
     int accept(InetAddress *peeraddr);
@@ -32,6 +32,12 @@ public:
     void setReuseAddr(bool on);
     void setReusePort(bool on);
     void setKeepAlive(bool on);
+    // TCP_DEFER_ACCEPT: accept is reported only when data arrives, or after seconds
+    void setDeferAccept(int seconds);
+    // TCP_FASTOPEN: accept data in SYN, qlen is the max number of pending TFO requests
+    void setFastOpen(int qlen);
+    // SO_BUSY_POLL/SO_PREFER_BUSY_POLL: poll the NIC queue for up to usec before sleeping, 0 turns it off
+    void setBusyPoll(int usec);
 
 private:
     const int sockfd_;
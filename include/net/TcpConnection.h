@@ -1,18 +1,29 @@
 #pragma once
 
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <stdint.h>
+
 #include <atomic>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <string>
 
 #include "Buffer.h"
 #include "Callbacks.h"
+#include "ChainBuffer.h"
+#include "Channel.h"
 #include "InetAddress.h"
+#include "SharedSlice.h"
+#include "Socket.h"
+#include "TimerId.h"
 #include "Timestamp.h"
+#include "ZeroCopyLinger.h"
 #include "Noncopyable.h"
 
-class Channel;
 class EventLoop;
-class Socket;
 
 // TcpServer => Acceptor => New user connection, get connfd by accept function
 // => TcpConnection set callbacks => set to Channel => Poller => Channel callback
@@ -24,21 +35,63 @@ public:
                   int sockfd,
                   const InetAddress &localAddr,
                   const InetAddress &peerAddr);
+
+    /**
+     * @brief Connection created by TcpServer, named lazily
+     * @param id Unique id, the high 32 bits are a sequence number, the name is *namePrefix followed by it
+     */
+    TcpConnection(EventLoop *loop,
+                  uint64_t id,
+                  const std::shared_ptr<const std::string> &namePrefix,
+                  int sockfd,
+                  const InetAddress &localAddr,
+                  const InetAddress &peerAddr);
     ~TcpConnection();
 
     EventLoop *getLoop() const { return loop_; }
-    const std::string &name() const { return name_; }
+    uint64_t id() const { return id_; }
+
+    // Formatted on first call, thread safe
+    const std::string &name() const;
     const InetAddress &localAddress() const { return localAddr_; }
     const InetAddress &peerAddress() const { return peerAddr_; }
 
     bool connected() const { return state_ == kConnected; }
 
+    // Thread safe, off loop calls copy buf once
     void send(const std::string &buf);
-    void sendFile(int fileDescriptor, off_t offset, size_t count);
+
+    /**
+     * @brief Owning sends, thread safe and zero copy
+     * @details The payload is moved into the loop, and linked into outputBuffer_ by reference
+     *          if the socket can not take all of it at once.
+     *          In the loop thread a string is written directly, it is only moved into a slice
+     *          when bytes are left unsent.
+     */
+    void send(std::string &&buf);
+    void send(Buffer &&buf);
+    void send(SharedSlice slice);
+
+    /**
+     * @brief Send count bytes of fileDescriptor from offset, thread safe
+     * @details The file is queued behind the data already sent(e.g. HTTP headers) and data sent later goes after it.
+     *          Regular files go out with sendfile, other sources with splice through the loop's pipe.
+     *          Transmission resumes on EPOLLOUT, so a slow client does not keep the loop busy.
+     *          fileDescriptor must stay open until onComplete, a non regular source must not return EAGAIN.
+     *          It stops early at end of file.
+     * @param onComplete Called once with the bytes sent and 0, or errno if the transfer failed
+     * @param onProgress Called each time some bytes of the file have been written to the socket
+     */
+    void sendFile(int fileDescriptor, off_t offset, size_t count,
+                  const SendFileCompleteCallback &onComplete = SendFileCompleteCallback(),
+                  const SendFileProgressCallback &onProgress = SendFileProgressCallback());
 
     // Shutdown connection
     void shutdown();
 
+    // Close the connection now, pending output is dropped, thread safe
+    void forceClose();
+
     void setConnectionCallback(const ConnectionCallback &cb)
     {
         connectionCallback_ = cb;
@@ -59,12 +112,59 @@ public:
         closeCallback_ = cb;
     }
 
+    /**
+     * @brief Keep owner alive as long as the connection
+     * @details For callbacks that capture a raw pointer into owner, such a small capture fits in std::function
+     *          without a heap allocation per connection.
+     */
+    void setCallbackOwner(const std::shared_ptr<const void> &owner) { callbackOwner_ = owner; }
+
     void setHighWaterMarkCallback(const HighWaterMarkCallback &cb, size_t highWaterMark)
     {
         highWaterMarkCallback_ = cb;
         highWaterMark_ = highWaterMark;
     }
 
+    /**
+     * @brief Use io_uring completion based recv/send instead of readiness + readv/write
+     * @details Only takes effect when the loop polls with IoUringPoller(MUDUO_USE_IOURING),
+     *          must be set before connectEstablished().
+     */
+    void setCompletionIo(bool on) { completionIo_ = on; }
+
+    /**
+     * @brief Register the socket with EPOLLET, handleRead drains it until EAGAIN
+     * @details Saves one poller wakeup per readv on bulk transfer connections.
+     *          At most eventByteBudget bytes are read per event, the rest is read in the next loop iteration
+     *          so one busy connection can not starve the others. Must be set before connectEstablished().
+     */
+    void setEdgeTriggered(bool on, size_t eventByteBudget);
+
+    /**
+     * @brief Send SharedSlice/std::string&&/Buffer&& payloads of at least threshold bytes with MSG_ZEROCOPY
+     * @details The kernel sends from the payload pages directly, the payload is pinned until its completion
+     *          is read from the socket error queue(reported as EPOLLERR). 0 disables it(default).
+     *          Only used by the readiness path, not by completion IO.
+     */
+    void setZeroCopyThreshold(size_t threshold) { zeroCopyThreshold_ = threshold; }
+
+    /**
+     * @brief Close stalled connections, in seconds, 0 disables a timeout
+     * @details readIdle: nothing received for that long, the connection is closed.
+     *          writeIdle: output pending and no byte written for that long, the connection is closed.
+     *          lifetime: connection older than that, the connection is shut down(pending output is flushed first).
+     *          One timer per connection is armed at the nearest deadline, reads and writes only record
+     *          the poll time, the timer re-arms itself if there was activity. Must be set before connectEstablished().
+     */
+    void setIdleTimeouts(double readIdle, double writeIdle, double lifetime);
+
+    /**
+     * @brief Set SO_BUSY_POLL(and SO_PREFER_BUSY_POLL) on the socket, 0 turns it off
+     * @details Receives poll the NIC queue for up to usec instead of waiting for the interrupt, pairs with
+     *          EventLoop::setBusyPoll(). Raising it above net.core.busy_read needs CAP_NET_ADMIN.
+     */
+    void setSocketBusyPoll(int usec);
+
     // TcpConnection Established
     void connectEstablished();
 
@@ -86,18 +186,67 @@ private:
     void handleClose();
     void handleError();
 
-    void sendInLoop(const void *data, size_t len);
+    // Write queued output: outputBuffer_ and files in the order they were sent
+    ssize_t writeOutputBuffer(size_t maxBytes, int *savedErrno);
+
+    // MSG_ZEROCOPY transmit path
+    ssize_t sendZeroCopy(const char *data, size_t len, const std::shared_ptr<const void> &owner);
+    bool handleZeroCopyCompletions();
+    void lingerZeroCopy();
+
+    // io_uring completion based IO path
+    bool startRecv();
+    void stopCompletionIo(); // Cancel the recv and the in flight send
+    void handleRecvComplete(int res, unsigned flags);
+    void submitSend();
+    void handleSendComplete(int res);
+
+    // owner != nullptr: data stays alive with owner, unsent bytes are linked into outputBuffer_ instead of copied
+    // movable != nullptr: data is *movable, moved into an owner only if some bytes have to outlive the call
+    void sendInLoop(const void *data, size_t len, const std::shared_ptr<const void> &owner, std::string *movable = nullptr);
+    void sendSliceInLoop(const SharedSlice &slice);
     void shutdownInLoop();
-    void sendFileInLoop(int fileDescriptor, off_t offset, size_t count);
+    void forceCloseInLoop();
+
+    // Idle and lifetime timeouts
+    void scheduleTimeout(Timestamp now);
+    void handleTimeout();
+    bool outputPending() const;
+    void sendFileInLoop(int fileDescriptor, off_t offset, size_t count,
+                        const SendFileCompleteCallback &onComplete, const SendFileProgressCallback &onProgress);
+
+    // A queued sendFile
+    struct FileTransfer
+    {
+        int fd;
+        off_t offset;          // Next byte to read, only used if the source is seekable
+        size_t count;          // Bytes requested
+        size_t remaining;      // Bytes not read from the source yet
+        size_t sent;           // Bytes written to the socket
+        size_t bufferedBefore; // outputBuffer_ bytes queued before this file and not written yet
+        bool splice;           // Use splice through the loop's pipe instead of sendfile
+        bool seekable;         // Source has file offsets(regular file or block device)
+        std::string residue;   // Bytes spliced from the source the socket did not take, taken out of the shared pipe
+        SendFileCompleteCallback onComplete;
+        SendFileProgressCallback onProgress;
+    };
+    ssize_t transmitFile(FileTransfer &transfer, size_t maxBytes, int *savedErrno);
+    ssize_t spliceFile(FileTransfer &transfer, size_t maxBytes, int *savedErrno);
+    void finishFileTransfer(int err);
+    void abortFileTransfers(int err);
+
     EventLoop *loop_;        // Depends on TcpServer thread number, if multiReactor -> subloop, or if singleReactor -> baseloop
-    const std::string name_; // TcpServer distribute connection name
+    const uint64_t id_;                                // TcpServer connection id, 0 if named by the user
+    const std::shared_ptr<const std::string> namePrefix_; // Shared by the connections of a TcpServer
+    mutable std::string name_;                         // Built by name() on first use
+    mutable std::once_flag nameOnce_;
     std::atomic_int state_;  // Connection state
     bool reading_;           // If connection is listening to read events
 
     // Socket Channel is simmilar to Acceptor
     // Acceptor => mainloop    TcpConnection => subloop
-    std::unique_ptr<Socket> socket_;
-    std::unique_ptr<Channel> channel_;
+    Socket socket_;
+    Channel channel_;
 
     const InetAddress localAddr_;
     const InetAddress peerAddr_;
@@ -108,9 +257,38 @@ private:
     WriteCompleteCallback writeCompleteCallback_; // Message sent complete callback
     HighWaterMarkCallback highWaterMarkCallback_; // Buffer data high water mark callback
     CloseCallback closeCallback_;                 // Close connection callback
+    std::shared_ptr<const void> callbackOwner_;   // Referenced by the callbacks
     size_t highWaterMark_;                        // Buffer data high water mark
+    size_t eventByteBudget_;                      // Max bytes read per event in edge triggered mode
 
     // Data buffer
-    Buffer inputBuffer_;  // Receive data buffer
-    Buffer outputBuffer_; // Send data buffer, user send data to outputBuffer_
+    Buffer inputBuffer_;       // Receive data buffer
+    ChainBuffer outputBuffer_; // Send data buffer, user send data to outputBuffer_, flushed with writev
+
+    std::deque<FileTransfer> fileTransfers_; // sendFile queue, front one is being sent
+
+    // Idle and lifetime timeouts, 0 disables
+    double readIdleTimeout_;
+    double writeIdleTimeout_;
+    double lifetime_;
+    Timestamp createTime_;    // connectEstablished() time
+    Timestamp lastReadTime_;  // Last time bytes were received
+    Timestamp lastWriteTime_; // Last write progress, or when output became pending
+    TimerId timeoutTimer_;    // Armed at the nearest deadline
+    bool timeoutArmed_;
+
+    // MSG_ZEROCOPY state
+    size_t zeroCopyThreshold_; // Min payload size to send with MSG_ZEROCOPY, 0 disables
+    bool zeroCopyEnabled_;     // SO_ZEROCOPY has been set on the socket
+    uint32_t zeroCopySeq_;     // Id of the next MSG_ZEROCOPY send, counted by kernel the same way
+    ZeroCopyLinger::Pending zeroCopyPending_; // Payloads pinned until kernel completion, handed to the loop on destroy
+
+    // io_uring completion IO state
+    bool completionIo_;                     // Completion IO requested by TcpServer
+    uint64_t recvToken_;                    // Multishot recv operation token, 0 means readiness path
+    uint64_t sendToken_;                    // Token of the in flight SENDMSG
+    bool sendInFlight_;                     // A SEND is submitted and not completed
+    std::unique_ptr<ChainBuffer> sendingBuffer_; // Data of the in flight SENDMSG, must not move until completion
+    struct iovec sendIov_[64];                   // iovecs of the in flight SENDMSG
+    struct msghdr sendMsg_;                      // msghdr of the in flight SENDMSG
 };
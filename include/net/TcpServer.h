@@ -8,7 +8,7 @@
 #include <string>
 #include <memory>
 #include <atomic>
-#include <unordered_map>
+#include <vector>
 
 #include "EventLoop.h"
 #include "Acceptor.h"
@@ -27,8 +27,9 @@ public:
 
     enum Option
     {
-        kNoReusePort, // 不允许重用本地端口
-        kReusePort,   // 允许重用本地端口
+        kNoReusePort,      // 不允许重用本地端口
+        kReusePort,        // 允许重用本地端口
+        kReusePortPerLoop, // 每个subloop各有一个SO_REUSEPORT监听socket, 由内核分发新连接, 连接直接在所属subloop中accept
     };
 
     TcpServer(EventLoop *loop,
@@ -42,8 +43,60 @@ public:
     void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
     void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
 
+    // 使用io_uring完成式读写(multishot recv + 批量send), 需要loop使用IoUringPoller(MUDUO_USE_IOURING)
+    void setCompletionIo(bool on) { completionIo_ = on; }
+
+    // 边缘触发(EPOLLET)模式: 监听socket和新连接都循环读到EAGAIN, 每个连接每次事件最多读eventByteBudget字节
+    // 需要在start()之前设置
+    void setEdgeTriggered(bool on, size_t eventByteBudget = 1024 * 1024);
+
+    // 新连接发送不小于threshold字节的引用计数数据(SharedSlice/string&&/Buffer&&)时使用MSG_ZEROCOPY, 0表示关闭
+    void setZeroCopyThreshold(size_t threshold) { zeroCopyThreshold_ = threshold; }
+
+    // 新连接的超时(秒, 0表示关闭): readIdle秒没有收到数据或writeIdle秒发不出数据则关闭连接, 存活超过lifetime秒则shutdown
+    // 每个连接只挂一个定时器, 读写只记录时间
+    void setIdleTimeouts(double readIdle, double writeIdle, double lifetime)
+    {
+        readIdleTimeout_ = readIdle;
+        writeIdleTimeout_ = writeIdle;
+        lifetime_ = lifetime;
+    }
+
     // 设置底层subloop的个数
     void setThreadNum(int numThreads);
+
+    // 每次可读事件最多accept的连接数(默认16), 一批连接按subloop分组移交, 每个subloop只唤醒一次, 需要在start()之前设置
+    void setAcceptBatch(int acceptBatch) { acceptBatch_ = acceptBatch; }
+
+    // 监听参数: listen的backlog(默认1024), TCP_DEFER_ACCEPT秒数, TCP_FASTOPEN队列长度, 0表示不设置, 需要在start()之前设置
+    void setListenOptions(int backlog, int deferAcceptSeconds = 0, int fastOpenQueue = 0)
+    {
+        backlog_ = backlog;
+        deferAcceptSeconds_ = deferAcceptSeconds;
+        fastOpenQueue_ = fastOpenQueue;
+    }
+
+    // 低延迟模式: subloop有事件后spinMicroSeconds微秒内用0超时轮询, 不在内核中休眠, 之后恢复阻塞等待
+    // socketBusyPollMicroSeconds > 0时新连接设置SO_BUSY_POLL/SO_PREFER_BUSY_POLL, 需要在start()之前设置
+    void setBusyPoll(int64_t spinMicroSeconds, int socketBusyPollMicroSeconds = 0)
+    {
+        busyPollMicroSeconds_ = spinMicroSeconds;
+        socketBusyPollMicroSeconds_ = socketBusyPollMicroSeconds;
+    }
+
+    // 各subloop(没有subloop时为baseloop)的忙轮询统计, 顺序与线程池中loop的顺序一致
+    std::vector<EventLoop::BusyPollStats> busyPollStats() const;
+
+    // subloop线程绑核: 第i个线程运行在threadCpus[i % threadCpus.size()]上, 需要在start()之前设置
+    void setThreadCpus(const std::vector<std::vector<int>> &threadCpus) { threadPool_->setThreadCpus(threadCpus); }
+    // subloop线程按NUMA节点轮流分布并绑定到节点的CPU上, 线程的内存池和缓冲区都在本节点分配, 需要在start()之前设置
+    void setNumaPlacement(bool on) { threadPool_->setNumaPlacement(on); }
+
+    // 新连接分配subloop的策略: 轮询(默认)/最少连接/随机二选一/按ip固定/按ip固定但限制负载, kReusePortPerLoop模式下由内核分发, 不使用
+    // capacityFactor: kBoundedIpAffinity模式下一个subloop的连接数最多是平均值的几倍, 超出的连接分给其他subloop
+    void setLoopSelection(EventLoopThreadPool::Selection selection, double capacityFactor = 1.25) { threadPool_->setSelection(selection, capacityFactor); }
+    // 自定义分配策略, 根据对端ip和各subloop当前连接数返回subloop下标
+    void setLoopSelector(const EventLoopThreadPool::LoopSelector &selector) { threadPool_->setSelector(selector); }
     /**
      * 如果没有监听, 就启动服务器(监听).
      * 多次调用没有副作用.
@@ -52,28 +105,147 @@ public:
     void start();
 
 private:
-    void newConnection(int sockfd, const InetAddress &peerAddr);
-    void removeConnection(const TcpConnectionPtr &conn);
-    void removeConnectionInLoop(const TcpConnectionPtr &conn);
+    // 按64位连接id索引的连接表: id低32位是槽位下标, 高32位是序号(即连接名中的编号)
+    // 插入删除都是O(1)的数组操作, 不构造字符串, 空出的槽位被新连接复用
+    class ConnectionMap
+    {
+    public:
+        ConnectionMap() : nextSeq_(1) {}
+
+        // 分配一个新连接的id, 之后用set()放入连接
+        uint64_t reserve()
+        {
+            uint32_t slot;
+            if (!freeSlots_.empty())
+            {
+                slot = freeSlots_.back();
+                freeSlots_.pop_back();
+            }
+            else
+            {
+                slot = static_cast<uint32_t>(slots_.size());
+                slots_.emplace_back();
+            }
+            if (nextSeq_ == 0) // 序号回绕时跳过0, 保证id不为0
+            {
+                nextSeq_ = 1;
+            }
+            uint64_t id = (static_cast<uint64_t>(nextSeq_++) << 32) | slot;
+            slots_[slot].id = id;
+            return id;
+        }
+
+        void set(uint64_t id, const TcpConnectionPtr &conn) { slots_[static_cast<uint32_t>(id)].conn = conn; }
+
+        void erase(uint64_t id)
+        {
+            uint32_t slot = static_cast<uint32_t>(id);
+            if (slot >= slots_.size() || slots_[slot].id != id)
+            {
+                return;
+            }
+            slots_[slot].id = 0;
+            slots_[slot].conn.reset();
+            freeSlots_.push_back(slot);
+        }
+
+        size_t size() const { return slots_.size() - freeSlots_.size(); }
+
+        // 取出所有连接并清空
+        std::vector<TcpConnectionPtr> takeAll()
+        {
+            std::vector<TcpConnectionPtr> conns;
+            for (Slot &slot : slots_)
+            {
+                if (slot.conn)
+                {
+                    conns.push_back(std::move(slot.conn));
+                }
+            }
+            slots_.clear();
+            freeSlots_.clear();
+            return conns;
+        }
+
+    private:
+        struct Slot
+        {
+            uint64_t id = 0; // 0表示空闲
+            TcpConnectionPtr conn;
+        };
+        std::vector<Slot> slots_;
+        std::vector<uint32_t> freeSlots_;
+        uint32_t nextSeq_;
+    };
+
+    // 用户回调, start()时拷贝一次, 所有连接共享
+    struct UserCallbacks
+    {
+        ConnectionCallback connection;
+        MessageCallback message;
+        WriteCompleteCallback writeComplete;
+    };
+
+    // 每个subloop(没有subloop时为baseloop)的连接表, kReusePortPerLoop模式下还有该subloop独有的监听socket
+    // 连接在所属loop线程中创建和销毁, 连接对象从该线程的内存池分配, 只在该loop线程中访问
+    struct LoopConnections
+    {
+        EventLoop *loop;
+        int id;
+        std::shared_ptr<const std::string> namePrefix; // 该loop连接名的前缀
+        std::unique_ptr<Acceptor> acceptor;            // kReusePortPerLoop模式下的监听socket, 否则为空
+        ConnectionMap connections;
+    };
+
+    // baseloop的acceptor接收到一批新连接, 按线程池的分配策略选择subloop, 把连接的fd按subloop批量移交
+    void newConnections(const Acceptor::AcceptedList &accepted);
+    LoopConnections *loopConnectionsOf(EventLoop *ioLoop);
+
+    // 在所属loop线程中创建连接并建立, 连接关闭后在该loop中移出连接表
+    void newLoopConnection(LoopConnections *loopConnections, int sockfd, const InetAddress &peerAddr);
+    void removeLoopConnection(LoopConnections *loopConnections, const TcpConnectionPtr &conn);
+
+    // 创建baseloop的acceptor, 创建时即绑定端口
+    void createAcceptor(bool reuseport);
+    // 设置acceptor的批量大小和监听参数
+    void configureAcceptor(Acceptor *acceptor);
+    // 在loop线程中销毁该loop的acceptor和连接
+    static void destroyLoopConnections(LoopConnections *loopConnections);
 
-    using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
+    // 从内存池创建TcpConnection(对象和控制块一次分配)并设置用户回调, 由调用者设置关闭回调
+    TcpConnectionPtr createConnection(EventLoop *ioLoop, uint64_t id, const std::shared_ptr<const std::string> &namePrefix, int sockfd, const InetAddress &peerAddr);
 
     EventLoop *loop_; // baseloop 用户自定义的loop
 
     const std::string ipPort_;
     const std::string name_;
+    const InetAddress listenAddr_;
+    const bool reusePortPerLoop_; // 是否为每个subloop创建监听socket
 
-    std::unique_ptr<Acceptor> acceptor_; // 运行在mainloop 任务就是监听新连接事件
+    std::unique_ptr<Acceptor> acceptor_; // 运行在mainloop 任务就是监听新连接事件, kReusePortPerLoop模式且有subloop时为空
+    std::vector<std::unique_ptr<LoopConnections>> loopConnections_; // 每个loop的连接表, 顺序与线程池中loop的顺序一致
 
     std::shared_ptr<EventLoopThreadPool> threadPool_; // one loop per thread
 
     ConnectionCallback connectionCallback_;       // 有新连接时的回调
     MessageCallback messageCallback_;             // 有读写事件发生时的回调
     WriteCompleteCallback writeCompleteCallback_; // 消息发送完成后的回调
+    std::shared_ptr<const UserCallbacks> userCallbacks_; // start()时的用户回调快照, 由连接共享
 
     ThreadInitCallback threadInitCallback_; // loop线程初始化的回调
     int numThreads_;                        // 线程池中线程的数量。
     std::atomic_int started_;
-    int nextConnId_;
-    ConnectionMap connections_; // 保存所有的连接
+    bool completionIo_;      // 新连接是否使用io_uring完成式读写
+    bool edgeTriggered_;     // 新连接是否使用边缘触发
+    size_t eventByteBudget_; // 边缘触发模式下每个连接每次事件最多读取的字节数
+    size_t zeroCopyThreshold_; // 新连接使用MSG_ZEROCOPY发送的最小字节数, 0表示关闭
+    double readIdleTimeout_;   // 新连接的读空闲超时(秒)
+    double writeIdleTimeout_;  // 新连接的写阻塞超时(秒)
+    double lifetime_;          // 新连接的最长存活时间(秒)
+    int acceptBatch_;          // 每次可读事件最多accept的连接数
+    int backlog_;              // listen的backlog
+    int deferAcceptSeconds_;   // TCP_DEFER_ACCEPT秒数, 0表示不设置
+    int fastOpenQueue_;        // TCP_FASTOPEN队列长度, 0表示不设置
+    int64_t busyPollMicroSeconds_;   // subloop有事件后忙轮询的时间(微秒), 0表示关闭
+    int socketBusyPollMicroSeconds_; // 新连接的SO_BUSY_POLL(微秒), 0表示不设置
 };
\ No newline at end of file
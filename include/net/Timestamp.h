@@ -69,4 +69,11 @@ inline Timestamp addTime(Timestamp timestamp, double seconds)
     return Timestamp(timestamp.microSecondsSinceEpoch() + delta);
 }
 
+// 两个时间戳相差的秒数
+inline double timeDifference(Timestamp high, Timestamp low)
+{
+    int64_t diff = high.microSecondsSinceEpoch() - low.microSecondsSinceEpoch();
+    return static_cast<double>(diff) / Timestamp::kMicroSecondsPerSecond;
+}
+
 #endif // TIME_STAMP_H
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "TimerId.h"
+#include "Noncopyable.h"
+
+class EventLoop;
+
+/**
+ * @brief Keep MSG_ZEROCOPY payloads of closed connections pinned until the kernel reports their completion
+ * @details The kernel may still send or retransmit from the payload pages after the connection is destroyed,
+ *          and completions are only readable from the socket error queue. The socket is kept open by a dup()
+ *          of its fd and its error queue polled by a timer of the loop until every payload is released.
+ *          Owned by EventLoop, used in the loop thread only.
+ */
+class ZeroCopyLinger : Noncopyable
+{
+public:
+    /// Send id of each MSG_ZEROCOPY send and the owner of its payload, in send order
+    using Pending = std::deque<std::pair<uint32_t, std::shared_ptr<const void>>>;
+
+    explicit ZeroCopyLinger(EventLoop *loop);
+    /// Close the kept sockets, payloads still pending are released with the loop
+    ~ZeroCopyLinger();
+
+    /**
+     * @brief Take over the pending payloads of a closed connection
+     * @param fd dup() of the connection socket, owned by the linger from now on
+     */
+    void add(int fd, Pending &&pending);
+
+    /**
+     * @brief Read zerocopy notifications from the error queue of fd and release the completed payloads
+     * @return true if the error queue only had zerocopy notifications
+     */
+    static bool reap(int fd, Pending *pending);
+
+    size_t size() const { return sockets_.size(); }
+
+private:
+    void poll();
+
+    EventLoop *loop_;
+    std::vector<std::pair<int, Pending>> sockets_;
+    TimerId timer_;
+    bool timerArmed_;
+};
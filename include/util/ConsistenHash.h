@@ -1,13 +1,17 @@
 #pragma once
 
-#include <algorithm>
+#include <stdint.h>
+
+#include <atomic>
 #include <functional>
+#include <memory>
 #include <mutex>
-#include <stdexcept>
 #include <string>
-#include <unordered_map>
+#include <thread>
 #include <vector>
 
+#include "Noncopyable.h"
+
 /**
  * @class ConsistentHash
  * @brief Implements the consistent hash algorithm class
@@ -15,92 +19,378 @@
  * ConsistentHash is a distributed hash algorithm that
  * aims to minimize the redistribution of keys when nodes are added or removed.
  * Usually used in distributed caching systems and sharding of distributed databases.
+ *
+ * Nodes are identified by a stable index: the index returned by addNode() does not change
+ * until the node is removed, a removed node's index is reused by the next addNode().
+ * Lookups are O(1) and lock free: they read an immutable snapshot of the nodes and the lookup table,
+ * addNode()/removeNode() build a new snapshot under a mutex and publish it atomically.
+ * A replaced snapshot is freed once no lookup can still be reading it(RCU style grace period),
+ * so addNode()/removeNode() wait for the lookups in progress and should stay rare.
  */
-class ConsistentHash
+class ConsistentHash : Noncopyable
 {
 public:
+    using HashFunction = std::function<size_t(const std::string &)>;
+
+    enum Algorithm
+    {
+        kJump,   ///< Jump consistent hash, no table, O(ln n) per lookup, best balance
+        kMaglev, ///< Maglev lookup table, one table read per lookup
+    };
+
+    static const size_t kDefaultTableSize = 65537; ///< Maglev table size, should be much larger than the number of nodes
+
     /**
      * @brief Constructor.
-     * @param numReplicas Virtual nodes number per physical node, add virtual nodes can improve load balancing effect
+     * @param algorithm Lookup algorithm
+     * @param tableSize Maglev table size, rounded up to a prime, not used by kJump
      * @param hashFunc Optional custom hash function, default is std::hash
      */
-    ConsistentHash(size_t numReplicas, std::function<size_t(const std::string &)> hashFunc = std::hash<std::string>())
-        : numReplicas_(numReplicas), hashFunction_(hashFunc) {}
+    explicit ConsistentHash(Algorithm algorithm = kMaglev,
+                            size_t tableSize = kDefaultTableSize,
+                            HashFunction hashFunc = std::hash<std::string>())
+        : algorithm_(algorithm), tableSize_(nextPrime(tableSize < 2 ? 2 : tableSize)), hashFunction_(hashFunc), current_(nullptr), epoch_(0)
+    {
+        readers_[0].store(0, std::memory_order_relaxed);
+        readers_[1].store(0, std::memory_order_relaxed);
+        publish(std::unique_ptr<Snapshot>(new Snapshot));
+    }
+
+    ~ConsistentHash() { delete current_.load(std::memory_order_relaxed); }
 
     /**
-     * @brief Add a node to the hash ring
-     * Every node is replicated as several virtual nodes, every virtual node is calculated by `node + index`(unique hash value)
-     * Theses hash values are stored in the hash ring and sorted for efficient lookup.
-     *
+     * @brief Add a node
      * @param node To add node name(like server address)
+     * @return Index of the node, the existing index if it was already added
      */
-    void addNode(const std::string &node)
+    int addNode(const std::string &node)
     {
         std::lock_guard<std::mutex> lock(mtx_);
-        for (size_t i = 0; i < numReplicas_; ++i)
+        const Snapshot *current = current_.load(std::memory_order_relaxed);
+        std::unique_ptr<Snapshot> next(new Snapshot);
+        next->nodes = current->nodes;
+        int index = -1;
+        for (size_t i = 0; i < next->nodes.size(); ++i)
+        {
+            if (next->nodes[i] == node)
+            {
+                return static_cast<int>(i);
+            }
+            if (index < 0 && next->nodes[i].empty())
+            {
+                index = static_cast<int>(i); // Reuse the first removed index
+            }
+        }
+        if (index < 0)
         {
-            // Caculate unique hash value for each virtual node
-            size_t hash = hashFunction_(node + "_0" + std::to_string(i));
-            circle_[hash] = node;          // Hash value map to node
-            sortedHashes_.push_back(hash); // Add to sorted hash list
+            index = static_cast<int>(next->nodes.size());
+            next->nodes.push_back(node);
         }
-        // Sort hash values
-        std::sort(sortedHashes_.begin(), sortedHashes_.end());
+        else
+        {
+            next->nodes[index] = node;
+        }
+        rebuild(*next);
+        publish(std::move(next));
+        return index;
     }
 
     /**
-     * @brief Remove a node from the hash ring
-     * Remove all virtual nodes and their corresponding hash values of the node.
+     * @brief Remove a node
+     * Only the keys of the removed node move to other nodes.
      *
      * @param node To remove node name
+     * @return false if node was not added
      */
-    void removeNode(const std::string &node)
+    bool removeNode(const std::string &node)
     {
         std::lock_guard<std::mutex> lock(mtx_);
-        for (size_t i = 0; i < numReplicas_; ++i)
+        const Snapshot *current = current_.load(std::memory_order_relaxed);
+        std::unique_ptr<Snapshot> next(new Snapshot);
+        next->nodes = current->nodes;
+        bool found = false;
+        for (std::string &name : next->nodes)
         {
-            // Calculate hash value for virtual node
-            size_t hash = hashFunction_(node + std::to_string(i));
-            circle_.erase(hash); // Remove from hash ring
-            auto it = std::find(sortedHashes_.begin(), sortedHashes_.end(), hash);
-            if (it != sortedHashes_.end())
+            if (name == node)
             {
-                sortedHashes_.erase(it); // Remove from sorted hash list
+                name.clear();
+                found = true;
             }
         }
+        if (!found)
+        {
+            return false;
+        }
+        while (!next->nodes.empty() && next->nodes.back().empty())
+        {
+            next->nodes.pop_back();
+        }
+        rebuild(*next);
+        publish(std::move(next));
+        return true;
     }
 
     /**
-     * @brief Find the node responsible for handling the given key
-     * Find the first node in the hash ring with a hash value greater than or equal to the key hash value.
-     * If not found (exceeds the maximum value of the hash ring), wrap around to the first node.
-     *
+     * @brief Find the node responsible for handling the given key, thread safe and lock free
      * @param key To find key(like data identifier)
-     * @return Node name responsible for handling the key
-     * @throws std::runtime_error If the hash ring is empty(no nodes)
+     * @return Node index, -1 if there is no node
      */
-    size_t getNode(const std::string &key)
+    int getNode(const std::string &key) const
     {
-        std::lock_guard<std::mutex> lock(mtx_);
-        if (circle_.empty())
+        ReadGuard guard(*this);
+        return lookup(guard.snapshot(), mix(hashFunction_(key)));
+    }
+
+    /**
+     * @brief Find the node for key with bounded load, thread safe and lock free
+     * @details No node gets more than ceil(capacityFactor * (total + 1) / nodes), where total is the sum of
+     *          loads of all nodes: if the node of key is full, the key goes to the next node of its probe sequence
+     *          that is not full. So hot keys spill over instead of overloading one node, and keys still stick
+     *          to the same node while it is not full. Costs one pass over loads to get the total.
+     * @param loads Current load of each node, indexed by node index, loads[i] must convert to an integer
+     * @param capacityFactor >= 1, smaller is more balanced, 1.25 moves few keys with good balance
+     * @return Node index, -1 if there is no node
+     */
+    template <typename Loads>
+    int getNode(const std::string &key, const Loads &loads, double capacityFactor) const
+    {
+        ReadGuard guard(*this);
+        const Snapshot &snapshot = guard.snapshot();
+        if (snapshot.live.empty())
+        {
+            return -1;
+        }
+        long total = 0;
+        for (int i : snapshot.live)
+        {
+            total += static_cast<long>(loads[i]);
+        }
+        const double capacity = capacityFactor * static_cast<double>(total + 1) / static_cast<double>(snapshot.live.size());
+        const long limit = static_cast<long>(capacity) + (capacity > static_cast<long>(capacity) ? 1 : 0);
+
+        uint64_t hash = mix(hashFunction_(key));
+        if (algorithm_ == kMaglev)
         {
-            throw std::runtime_error("No nodes in consistent hash");
+            // Walk the table from the key's entry, every node appears in it, so one not full is found
+            const size_t start = static_cast<size_t>(hash % snapshot.table.size());
+            for (size_t i = 0; i < snapshot.table.size(); ++i)
+            {
+                int node = snapshot.table[(start + i) % snapshot.table.size()];
+                if (static_cast<long>(loads[node]) < limit)
+                {
+                    return node;
+                }
+            }
         }
-        size_t hash = hashFunction_(key); // Calculate key hash value
-        // Find the first position in the sorted hash list with a hash value greater than or equal to the key hash value
-        auto it = std::upper_bound(sortedHashes_.begin(), sortedHashes_.end(), hash);
-        if (it == sortedHashes_.end())
+        else
         {
-            // If exceeds the maximum value of the hash ring, wrap around to the first node
-            it = sortedHashes_.begin();
+            // Rehash until a node that is not full is hit
+            for (size_t i = 0; i < 2 * snapshot.nodes.size() + 8; ++i)
+            {
+                int node = lookup(snapshot, hash);
+                if (static_cast<long>(loads[node]) < limit)
+                {
+                    return node;
+                }
+                hash = mix(hash + i + 1);
+            }
+        }
+        // Only reached if loads changed under us or capacityFactor < 1, take the least loaded node
+        int least = snapshot.live[0];
+        for (int i : snapshot.live)
+        {
+            if (static_cast<long>(loads[i]) < static_cast<long>(loads[least]))
+            {
+                least = i;
+            }
         }
-        return *it; // Return corresponding hash value
+        return least;
+    }
+
+    /**
+     * @brief Name of the node at index, empty if index is not a node
+     */
+    std::string nodeName(int index) const
+    {
+        ReadGuard guard(*this);
+        const Snapshot &snapshot = guard.snapshot();
+        return index >= 0 && static_cast<size_t>(index) < snapshot.nodes.size() ? snapshot.nodes[index] : std::string();
+    }
+
+    /**
+     * @brief Number of nodes
+     */
+    size_t size() const
+    {
+        ReadGuard guard(*this);
+        return guard.snapshot().live.size();
     }
 
 private:
-    size_t numReplicas_;                                      // Number of virtual nodes per physical node
-    std::function<size_t(const std::string &)> hashFunction_; // Custom or default hash function
-    std::unordered_map<size_t, std::string> circle_;          // Hash value to node name mapping
-    std::vector<size_t> sortedHashes_;                        // Sorted hash value list for efficient lookup
-    std::mutex mtx_;                                          // Mutex to protect hash ring, ensuring thread safety
+    // Immutable after publish()
+    struct Snapshot
+    {
+        std::vector<std::string> nodes; // Index to node name, empty for a removed index
+        std::vector<int> live;          // Indexes of the nodes
+        std::vector<int> table;         // Maglev lookup table, empty for kJump
+    };
+
+    // Registers a lookup in readers_ of the current epoch while it reads the current snapshot
+    class ReadGuard : Noncopyable
+    {
+    public:
+        explicit ReadGuard(const ConsistentHash &hash)
+            : slot_(hash.readers_[hash.epoch_.load() & 1])
+        {
+            slot_.fetch_add(1);
+            snapshot_ = hash.current_.load(); // After the registration, publish() waits for it or sees it
+        }
+        ~ReadGuard() { slot_.fetch_sub(1); }
+
+        const Snapshot &snapshot() const { return *snapshot_; }
+
+    private:
+        std::atomic<int> &slot_;
+        const Snapshot *snapshot_;
+    };
+
+    // splitmix64 finalizer, spreads weak hash functions over 64 bits
+    static uint64_t mix(uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    static size_t nextPrime(size_t n)
+    {
+        for (;; ++n)
+        {
+            bool prime = true;
+            for (size_t d = 2; d * d <= n; ++d)
+            {
+                if (n % d == 0)
+                {
+                    prime = false;
+                    break;
+                }
+            }
+            if (prime)
+            {
+                return n;
+            }
+        }
+    }
+
+    // Jump consistent hash(Lamping & Veach), bucket in [0, buckets)
+    static int jump(uint64_t key, int buckets)
+    {
+        int64_t b = -1;
+        int64_t j = 0;
+        while (j < buckets)
+        {
+            b = j;
+            key = key * 2862933555777941757ULL + 1;
+            j = static_cast<int64_t>((b + 1) * (static_cast<double>(1LL << 31) / static_cast<double>((key >> 33) + 1)));
+        }
+        return static_cast<int>(b);
+    }
+
+    int lookup(const Snapshot &snapshot, uint64_t hash) const
+    {
+        if (snapshot.live.empty())
+        {
+            return -1;
+        }
+        if (algorithm_ == kMaglev)
+        {
+            return snapshot.table[hash % snapshot.table.size()];
+        }
+        // Jump hash only supports removing the last bucket, a removed index in the middle rehashes the key
+        const int buckets = static_cast<int>(snapshot.nodes.size());
+        int node = jump(hash, buckets);
+        while (snapshot.nodes[node].empty())
+        {
+            hash = mix(hash);
+            node = jump(hash, buckets);
+        }
+        return node;
+    }
+
+    void rebuild(Snapshot &snapshot) const
+    {
+        for (size_t i = 0; i < snapshot.nodes.size(); ++i)
+        {
+            if (!snapshot.nodes[i].empty())
+            {
+                snapshot.live.push_back(static_cast<int>(i));
+            }
+        }
+        if (algorithm_ != kMaglev || snapshot.live.empty())
+        {
+            return;
+        }
+
+        // Every node fills the table in the order of its own permutation(offset + j * skip) % M, taking turns,
+        // so each node gets about M / n entries and a membership change only moves few entries
+        const uint64_t m = tableSize_;
+        const size_t n = snapshot.live.size();
+        std::vector<uint64_t> offset(n), skip(n), next(n, 0);
+        for (size_t i = 0; i < n; ++i)
+        {
+            uint64_t hash = hashFunction_(snapshot.nodes[snapshot.live[i]]);
+            offset[i] = mix(hash) % m;
+            skip[i] = mix(hash ^ 0x5bd1e9955bd1e995ULL) % (m - 1) + 1;
+        }
+        snapshot.table.assign(m, -1);
+        size_t filled = 0;
+        while (true)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                uint64_t c = (offset[i] + next[i] * skip[i]) % m;
+                while (snapshot.table[c] >= 0)
+                {
+                    ++next[i];
+                    c = (offset[i] + next[i] * skip[i]) % m;
+                }
+                snapshot.table[c] = snapshot.live[i];
+                ++next[i];
+                if (++filled == m)
+                {
+                    return;
+                }
+            }
+        }
+    }
+
+    // Called under mtx_ (or from the constructor), frees the replaced snapshot after a grace period
+    void publish(std::unique_ptr<Snapshot> snapshot)
+    {
+        std::unique_ptr<const Snapshot> old(current_.exchange(snapshot.release()));
+        if (!old)
+        {
+            return;
+        }
+        // A lookup that can read old registered before the exchange, in the readers_ slot of the epoch it saw.
+        // Flip the epoch twice and wait for each slot to drain: new lookups go to the other slot, so the wait ends
+        // even under constant lookups, and both slots are covered
+        for (int round = 0; round < 2; ++round)
+        {
+            const unsigned epoch = epoch_.fetch_add(1);
+            while (readers_[epoch & 1].load() != 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    const Algorithm algorithm_;
+    const size_t tableSize_;                              // Maglev table size, prime
+    HashFunction hashFunction_;                           // Custom or default hash function
+    std::atomic<const Snapshot *> current_;               // Snapshot read by lookups, owned by this object
+    std::atomic<unsigned> epoch_;                         // Parity selects the readers_ slot of new lookups
+    mutable std::atomic<int> readers_[2];                 // Lookups in progress per epoch parity
+    std::mutex mtx_;                                      // Serializes addNode/removeNode
 };
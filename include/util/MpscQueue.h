@@ -0,0 +1,170 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Noncopyable.h"
+
+/**
+ * @brief Multi-producer single-consumer queue: lock-free bounded ring + locked overflow list
+ * @details Fast path is Dmitry Vyukov's bounded queue: producers claim a slot with one CAS on enqueuePos_
+ *          and publish it by storing the slot sequence, the consumer never touches enqueuePos_.
+ *          Slots are reused, so push/pop do not allocate.
+ *          When the ring is full, items go to overflow_ under mutex_, and overflowing_ keeps sending
+ *          later pushes there until the consumer has taken the whole overflow list. Before taking the
+ *          overflow list the consumer pops every ring slot claimed so far, waiting for slots whose producer
+ *          is still writing them, so items pushed by one thread are popped in push order.
+ * @note push() is thread safe, popAll() must always be called from the same (consumer) thread.
+ */
+template <typename T>
+class MpscQueue : Noncopyable
+{
+public:
+    /**
+     * @param capacity Ring size, rounded up to power of 2
+     */
+    explicit MpscQueue(size_t capacity = 1024)
+        : mask_(roundUp(capacity) - 1), slots_(new Slot[mask_ + 1]), enqueuePos_(0), dequeuePos_(0), overflowing_(false)
+    {
+        for (size_t i = 0; i <= mask_; ++i)
+        {
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Push a value, called from any thread
+     */
+    void push(T value)
+    {
+        if (!overflowing_.load(std::memory_order_acquire) && tryPush(value))
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        overflowing_.store(true, std::memory_order_release);
+        overflow_.push_back(std::move(value));
+    }
+
+    /**
+     * @brief Move all values pushed so far to the back of out, called from the consumer thread only
+     * @return Number of values moved
+     */
+    size_t popAll(std::vector<T> &out)
+    {
+        size_t n = 0;
+        while (tryPop(out))
+        {
+            ++n;
+        }
+
+        if (overflowing_.load(std::memory_order_acquire))
+        {
+            std::vector<T> overflow;
+            size_t end;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                /// Every ring push that happened before an overflow push in overflow_ has claimed a slot below end
+                end = enqueuePos_.load(std::memory_order_relaxed);
+                overflow.swap(overflow_);
+                overflowing_.store(false, std::memory_order_release);
+            }
+            /// Those slots go out first, wait for producers still writing them
+            while (dequeuePos_ != end)
+            {
+                if (tryPop(out))
+                {
+                    ++n;
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+            for (T &value : overflow)
+            {
+                out.push_back(std::move(value));
+            }
+            n += overflow.size();
+        }
+        return n;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> seq; ///< == pos: free for producer of pos, == pos + 1: filled for consumer
+        T value;
+    };
+
+    static size_t roundUp(size_t n)
+    {
+        size_t size = 2;
+        while (size < n)
+        {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    /**
+     * @brief Pop the slot at dequeuePos_ if its producer has published it
+     */
+    bool tryPop(std::vector<T> &out)
+    {
+        Slot &slot = slots_[dequeuePos_ & mask_];
+        if (slot.seq.load(std::memory_order_acquire) != dequeuePos_ + 1)
+        {
+            return false; ///< Empty, or the producer of this slot has not finished writing it
+        }
+        out.push_back(std::move(slot.value));
+        slot.seq.store(dequeuePos_ + mask_ + 1, std::memory_order_release); ///< Free the slot for the next lap
+        ++dequeuePos_;
+        return true;
+    }
+
+    bool tryPush(T &value)
+    {
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot &slot = slots_[pos & mask_];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    slot.value = std::move(value);
+                    slot.seq.store(pos + 1, std::memory_order_release); ///< Publish to the consumer
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; ///< Ring is full
+            }
+            else
+            {
+                pos = enqueuePos_.load(std::memory_order_relaxed); ///< Another producer took this slot
+            }
+        }
+    }
+
+    const size_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+
+    alignas(64) std::atomic<size_t> enqueuePos_; ///< Shared by producers
+    alignas(64) size_t dequeuePos_;              ///< Consumer only
+
+    alignas(64) std::atomic_bool overflowing_; ///< overflow_ is not empty, producers must not use the ring
+    std::mutex mutex_;                         ///< Protect overflow_
+    std::vector<T> overflow_;
+};
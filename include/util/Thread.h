@@ -7,6 +7,7 @@
 #include <memory>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "Noncopyable.h"
 
@@ -21,6 +22,10 @@ public:
     void start();
     void join();
 
+    // Pin the thread to cpus, must be called before start(), empty means no pinning
+    // Ids outside [0, CPU_SETSIZE) are logged and ignored
+    void setCpuAffinity(const std::vector<int> &cpus) { cpus_ = cpus; }
+
     bool started() { return started_; }
     pid_t tid() const { return tid_; }
     const std::string &name() const { return name_; }
@@ -29,6 +34,7 @@ public:
 
 private:
     void setDefaultName();
+    void initInThread(); // Set name and cpu affinity of the running thread
 
     bool started_;
     bool joined_;
@@ -36,5 +42,6 @@ private:
     pid_t tid_;       // Bind when thread created
     ThreadFunc func_; // Thread callback function
     std::string name_;
+    std::vector<int> cpus_; // Cpu affinity, empty means no pinning
     static std::atomic_int numCreated_;
 };
\ No newline at end of file
@@ -1,6 +1,10 @@
 #ifndef TIMER_H
 #define TIMER_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
 #include <functional>
 
 #include "Timestamp.h"
@@ -15,10 +19,19 @@ public:
         : callback_(move(cb)),
           expiration_(when),
           interval_(interval),
-          repeat_(interval > 0.0)
+          repeat_(interval > 0.0),
+          sequence_(++s_numCreated_),
+          prev_(nullptr),
+          next_(nullptr),
+          slot_(nullptr),
+          tick_(0)
     {
     }
 
+    // 定时器节点从内存池分配, 数十万连接各挂一个定时器时避免频繁malloc
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr, size_t size);
+
     void run() const
     {
         callback_();
@@ -26,14 +39,26 @@ public:
 
     Timestamp expiration() const { return expiration_; }
     bool repeat() const { return repeat_; }
+    int64_t sequence() const { return sequence_; }
 
     void restart(Timestamp now);
 
 private:
+    friend class TimerQueue;
+
     const TimerCallback callback_; // Timer call back function
     Timestamp expiration_;         // The next expiration time
     const double interval_;        // Time out interval, if one-time timer, is 0
     const bool repeat_;            // Whether it is repeated (false means one-time timer)
+    const int64_t sequence_;       // 全局唯一序号, TimerId用它识别定时器
+
+    static std::atomic<int64_t> s_numCreated_; // 已创建的定时器个数, 用于生成序号
+
+    // 时间轮槽位中的双向链表节点, 由TimerQueue维护
+    Timer *prev_;
+    Timer *next_;
+    void *slot_;    // 所在的槽位, 不在时间轮中时为nullptr
+    uint64_t tick_; // 到期的tick(毫秒)
 };
 
-#endif // TIMER_H
\ No newline at end of file
+#endif // TIMER_H
@@ -0,0 +1,34 @@
+#ifndef TIMER_ID_H
+#define TIMER_ID_H
+
+#include <stdint.h>
+
+class Timer;
+
+/**
+ * 定时器句柄, 由EventLoop::runAt/runAfter/runEvery返回, 用于EventLoop::cancel
+ * 只保存定时器地址和序号, 可以随意复制; 序号全局唯一, 定时器释放后地址被复用也不会误取消
+ */
+class TimerId
+{
+public:
+    TimerId()
+        : timer_(nullptr),
+          sequence_(0)
+    {
+    }
+
+    TimerId(Timer *timer, int64_t seq)
+        : timer_(timer),
+          sequence_(seq)
+    {
+    }
+
+    friend class TimerQueue;
+
+private:
+    Timer *timer_;
+    int64_t sequence_;
+};
+
+#endif // TIMER_ID_H
@@ -3,13 +3,23 @@
 
 #include "Timestamp.h"
 #include "Channel.h"
+#include "TimerId.h"
 
+#include <stdint.h>
+
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
-#include <set>
 
 class EventLoop;
 class Timer;
 
+/**
+ * 分层时间轮定时器队列
+ * tick为1毫秒, 第0层256个槽, 之后4层各64个槽, 覆盖2^32个tick(约49.7天), 更远的定时器放在最高层并在到期前逐层下移
+ * 插入/删除为O(1)的链表操作, 到期时按tick批量取出整个槽位,
+ * timerfd_只在最近的非空槽位(或需要下移的高层槽位)到期时唤醒loop, 每次处理后最多调用一次timerfd_settime
+ */
 class TimerQueue
 {
 public:
@@ -18,41 +28,75 @@ public:
     explicit TimerQueue(EventLoop* loop);
     ~TimerQueue();
 
-    // 插入定时器（回调函数，到期时间，是否重复）
-    void addTimer(TimerCallback cb,
-                  Timestamp when,
-                  double interval);
-    
+    // 插入定时器（回调函数，到期时间，是否重复）, 返回用于取消的TimerId
+    // 线程安全
+    TimerId addTimer(TimerCallback cb,
+                     Timestamp when,
+                     double interval);
+
+    // 取消定时器, 已经到期或取消过的定时器忽略
+    // 线程安全, 也可以在定时器回调中调用(包括取消自己这个重复定时器)
+    void cancel(TimerId timerId);
+
 private:
-    using Entry = std::pair<Timestamp, Timer*>; // 以时间戳作为键值获取定时器
-    using TimerList = std::set<Entry>;          // 底层使用红黑树管理，自动按照时间戳进行排序
+    static const int kTickMicroSeconds = 1000;   // 1 tick = 1ms
+    static const int kRootBits = 8;              // 第0层 256 个槽
+    static const int kLevelBits = 6;             // 第1~4层 64 个槽
+    static const int kLevels = 5;
+    static const int kRootSize = 1 << kRootBits;
+    static const int kLevelSize = 1 << kLevelBits;
+
+    // 槽位链表头, Timer::prev_/next_串起同一槽位的定时器
+    struct Slot
+    {
+        Timer* head = nullptr;
+        Timer* tail = nullptr;
+    };
 
     // 在本loop中添加定时器
     // 线程安全
     void addTimerInLoop(Timer* timer);
+    void cancelInLoop(TimerId timerId);
 
     // 定时器读事件触发的函数
     void handleRead();
 
-    // 重新设置timerfd_
-    void resetTimerfd(int timerfd_, Timestamp expiration);
-    
-    // 移除所有已到期的定时器
-    // 1.获取到期的定时器
-    // 2.重置这些定时器（销毁或者重复定时任务）
-    std::vector<Entry> getExpired(Timestamp now);
-    void reset(const std::vector<Entry>& expired, Timestamp now);
+    // 重新设置timerfd_, 让loop在tick到期时醒来
+    void resetTimerfd(int timerfd_, uint64_t tick);
+
+    // 时间戳向上取整到tick, 保证定时器不会提前触发
+    static uint64_t toTick(Timestamp when);
 
-    // 插入定时器的内部方法
-    bool insert(Timer* timer);
+    // 按到期tick与currentTick_的距离放入对应层的槽位
+    void insert(Timer* timer);
+    void link(Slot& slot, Timer* timer);
+    void unlink(Timer* timer);
+
+    // 把高层的一个槽位重新分配到低层, 返回该层的槽位下标
+    int cascade(int level, int index);
+
+    // 推进时间轮到nowTick, 取出所有到期的定时器
+    void advance(uint64_t nowTick, std::vector<Timer*>& expired);
+
+    // 下一个需要处理的tick(非空的第0层槽位或需要下移的高层槽位), 没有定时器时返回0
+    uint64_t nextEventTick() const;
 
     EventLoop* loop_;           // 所属的EventLoop
     const int timerfd_;         // timerfd是Linux提供的定时器接口
     Channel timerfdChannel_;    // 封装timerfd_文件描述符
-    // Timer list sorted by expiration
-    TimerList timers_;          // 定时器队列（内部实现是红黑树）
+
+    Slot root_[kRootSize];                         // 第0层, 每个槽1个tick
+    Slot levels_[kLevels - 1][kLevelSize];         // 第1~4层
+    uint64_t currentTick_;      // 下一个要处理的tick
+    uint64_t armedTick_;        // timerfd_当前设置的到期tick, 0表示未设置
+    size_t count_;              // 时间轮中的定时器数量
+
+    // 未释放的定时器, 按序号索引; 取消时先查这里, 不会访问已经释放的Timer
+    std::unordered_map<int64_t, Timer*> activeTimers_;
+    // 到期回调执行期间被取消的本批定时器, 跳过回调且不再重复
+    std::unordered_set<int64_t> cancelingTimers_;
 
     bool callingExpiredTimers_; // 标明正在获取超时定时器
 };
 
-#endif // TIMER_QUEUE_H
\ No newline at end of file
+#endif // TIMER_QUEUE_H
@@ -1,102 +1,559 @@
 #include "AsyncLogging.h"
 #include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "BinaryLog.h"
+#include "CurrentThread.h"
+#include "Logger.h"
+#include "Timestamp.h"
+
+namespace
+{
+    // 每个前端线程注册到各AsyncLogging的StagingBuffer, 线程退出时标记为retired, 后端写完后释放
+    struct ThreadStagings
+    {
+        std::vector<std::pair<uint64_t, std::shared_ptr<StagingBuffer>>> buffers;
+        ~ThreadStagings();
+    };
+    thread_local ThreadStagings t_stagings;
+    thread_local bool t_stagingsExited = false;       // t_stagings已经析构, 之后的日志走共享缓冲区
+    thread_local uint64_t t_lastOwner = 0;            // 最近一次写日志的AsyncLogging的id_
+    thread_local StagingBuffer *t_lastBuffer = nullptr; // 最近一次使用的StagingBuffer
+
+    ThreadStagings::~ThreadStagings()
+    {
+        t_stagingsExited = true;
+        t_lastOwner = 0;
+        t_lastBuffer = nullptr;
+        for (auto &buffer : buffers)
+        {
+            buffer.second->retire();
+        }
+    }
+
+    // 在作用域内标记StagingBuffer正在写入
+    class StagingWriteGuard
+    {
+    public:
+        explicit StagingWriteGuard(StagingBuffer *buffer) : buffer_(buffer) { buffer_->beginWrite(); }
+        ~StagingWriteGuard() { buffer_->endWrite(); }
+
+    private:
+        StagingBuffer *buffer_;
+    };
+
+    constexpr size_t kDefaultThreadBufferSize = 256 * 1024;
+    // 归并模式下每行日志前的记录头: 写入时间(微秒)和长度
+    constexpr size_t kRecordHeaderSize = sizeof(int64_t) + sizeof(uint32_t);
+}
+
+std::atomic<uint64_t> AsyncLogging::s_nextId_(1);
+
 AsyncLogging::AsyncLogging(const std::string &basename, off_t rollSize, int flushInterval)
     :
       flushInterval_(flushInterval),
       running_(false),
       basename_(basename),
       rollSize_(rollSize),
+      fileOptions_(),
       thread_(std::bind(&AsyncLogging::threadFunc, this), "Logging"),
       mutex_(),
       cond_(),
+      spaceCond_(),
       currentBuffer_(new LargeBuffer),
-      nextBuffer_(new LargeBuffer),
-      buffers_()
+      buffers_(),
+      freeBuffers_(),
+      allocatedBuffers_(2),
+      maxQueuedBuffers_(16),
+      overflowPolicy_(kBlock),
+      blockTimeout_(100),
+      droppedLines_(0),
+      droppedBytes_(0),
+      reportedDroppedLines_(0),
+      id_(s_nextId_++),
+      threadBufferSize_(kDefaultThreadBufferSize),
+      mergeByTime_(false),
+      binary_(false),
+      dictionaryWritten_(0),
+      stagingFull_(false)
 {
     currentBuffer_->bzero();
-    nextBuffer_->bzero();
-    buffers_.reserve(16); // 只维持队列长度2~16.
+    freeBuffers_.emplace_back(new LargeBuffer);
+    freeBuffers_.back()->bzero();
+    buffers_.reserve(16);
 }
 // 调用此函数解决前端把LOG_XXX<<"..."传递给后端，后端再将日志消息写入日志文件
 void AsyncLogging::append(const char *logline, int len)
 {
-    std::lock_guard<std::mutex> lg(mutex_);
-    // 缓冲区剩余的空间足够写入
-    if (currentBuffer_->avail() > static_cast<size_t>(len))
+    if (binary_)
     {
-        currentBuffer_->append(logline, len);
+        // 二进制日志文件中的文本行也是一条记录
+        BinaryLog::RecordHeader header = {BinaryLog::kTextFormatId, static_cast<uint32_t>(sizeof(header) + len), 0};
+        appendRecord(reinterpret_cast<const char *>(&header), sizeof(header), logline, len, -1);
     }
     else
     {
-        buffers_.push_back(std::move(currentBuffer_));
+        appendRecord(nullptr, 0, logline, len, -1);
+    }
+}
+
+void AsyncLogging::appendBinary(const char *record, int len, Logger::LogLevel level)
+{
+    if (binary_)
+    {
+        appendRecord(nullptr, 0, record, len, level);
+        return;
+    }
+    // 文本日志文件, 在前端渲染成文本
+    std::string line;
+    if (BinaryLog::formatRecord(record, len, &line))
+    {
+        appendRecord(nullptr, 0, line.data(), static_cast<int>(line.size()), level);
+    }
+}
+
+void AsyncLogging::appendRecord(const char *recordHeader, size_t recordHeaderLen, const char *data, int len, int level)
+{
+    // 还没有启动, 或者是后端线程自己写日志(不能等待自己), 写入共享缓冲区
+    if (!running_ || t_stagingsExited || CurrentThread::tid() == thread_.tid())
+    {
+        appendLocked(recordHeader, recordHeaderLen, data, len, level);
+        return;
+    }
+    StagingBuffer *buffer = t_lastOwner == id_ ? t_lastBuffer : threadBuffer();
+    // 标记写入中之后再检查一次: stop()之后后端的最后一轮会等这一行写完, 否则这里能看到running_为false
+    StagingWriteGuard writing(buffer);
+    if (!running_)
+    {
+        appendLocked(recordHeader, recordHeaderLen, data, len, level);
+        return;
+    }
+
+    // StagingBuffer中每行之前的内容: 归并用的时间和长度, 加上二进制记录头
+    char header[kRecordHeaderSize + sizeof(BinaryLog::RecordHeader)];
+    size_t headerLen = 0;
+    if (mergeByTime_)
+    {
+        int64_t now = Timestamp::now().microSecondsSinceEpoch();
+        uint32_t length = static_cast<uint32_t>(recordHeaderLen + len);
+        memcpy(header, &now, sizeof(now));
+        memcpy(header + sizeof(now), &length, sizeof(length));
+        headerLen = kRecordHeaderSize;
+    }
+    if (recordHeaderLen > 0)
+    {
+        memcpy(header + headerLen, recordHeader, recordHeaderLen);
+        headerLen += recordHeaderLen;
+    }
+    if (headerLen + static_cast<size_t>(len) > buffer->capacity())
+    {
+        appendLocked(recordHeader, recordHeaderLen, data, len, level);
+        return;
+    }
+    // 缓冲区满了就按overflowPolicy_丢弃, 或者唤醒后端并等待它取走日志, 不改变本线程日志的顺序
+    std::chrono::steady_clock::time_point deadline;
+    bool waiting = false;
+    while (!buffer->append(header, headerLen, data, len))
+    {
+        if (!running_)
+        {
+            appendLocked(recordHeader, recordHeaderLen, data, len, level);
+            return;
+        }
+        if (!waiting)
+        {
+            if (dropWithoutWaiting(data, len, level))
+            {
+                countDropped(len);
+                return;
+            }
+            deadline = std::chrono::steady_clock::now() + blockTimeout_;
+            waiting = true;
+        }
+        else if (std::chrono::steady_clock::now() >= deadline)
+        {
+            countDropped(len);
+            return;
+        }
+        // 标志在锁内设置, 后端检查等待条件时不会错过; 后端取走日志后持锁通知spaceCond_,
+        // 持锁重试写入失败再等待就不会错过通知, 不用空转
+        std::unique_lock<std::mutex> lg(mutex_);
+        stagingFull_.store(true, std::memory_order_relaxed);
+        cond_.notify_one();
+        if (buffer->append(header, headerLen, data, len))
+        {
+            break;
+        }
+        spaceCond_.wait_until(lg, deadline);
+    }
+    // 积压超过一半时提前唤醒后端, 不用等到flushInterval_
+    if (buffer->halfFull() && !stagingFull_.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lg(mutex_);
+        stagingFull_.store(true, std::memory_order_relaxed);
+        cond_.notify_one();
+    }
+}
 
-        if (nextBuffer_)
+void AsyncLogging::appendLocked(const char *recordHeader, size_t recordHeaderLen, const char *data, int len, int level)
+{
+    std::unique_lock<std::mutex> lg(mutex_);
+    // 缓冲区剩余的空间足够写入
+    if (currentBuffer_->avail() > recordHeaderLen + len)
+    {
+        appendTo(currentBuffer_.get(), recordHeader, recordHeaderLen, data, len);
+        return;
+    }
+    std::chrono::steady_clock::time_point deadline;
+    bool waiting = false;
+    while (true)
+    {
+        if (buffers_.size() < maxQueuedBuffers_)
+        {
+            BufferPtr buffer = takeFreeBufferLocked();
+            if (buffer)
+            {
+                buffers_.push_back(std::move(currentBuffer_));
+                currentBuffer_ = std::move(buffer);
+                appendTo(currentBuffer_.get(), recordHeader, recordHeaderLen, data, len);
+                // 唤醒后端线程写入磁盘
+                cond_.notify_one();
+                return;
+            }
+        }
+        // 队列已满, 后端没有运行或者是后端线程自己写日志时不能等待
+        if (!waiting)
         {
-            currentBuffer_ = std::move(nextBuffer_);
+            if (!running_ || CurrentThread::tid() == thread_.tid() || dropWithoutWaiting(data, len, level))
+            {
+                countDropped(len);
+                return;
+            }
+            deadline = std::chrono::steady_clock::now() + blockTimeout_;
+            waiting = true;
         }
-        else
+        else if (std::chrono::steady_clock::now() >= deadline)
         {
-            currentBuffer_.reset(new LargeBuffer);
+            // 超时后仍然拿不到缓冲区就丢弃, 不论是队列满还是空闲缓冲区用完, 等待时间不超过blockTimeout_
+            countDropped(len);
+            return;
         }
-        currentBuffer_->append(logline, len);
-        // 唤醒后端线程写入磁盘
         cond_.notify_one();
+        spaceCond_.wait_until(lg, deadline);
+    }
+}
+
+void AsyncLogging::appendTo(LargeBuffer *buffer, const char *recordHeader, size_t recordHeaderLen, const char *data, int len)
+{
+    if (recordHeaderLen > 0)
+    {
+        buffer->append(recordHeader, recordHeaderLen);
+    }
+    buffer->append(data, len);
+}
+
+bool AsyncLogging::dropWithoutWaiting(const char *data, int len, int level) const
+{
+    if (overflowPolicy_ == kDropNewest)
+    {
+        return true;
+    }
+    // 文本日志从行中取出等级
+    return overflowPolicy_ == kDropDebugFirst && (level >= 0 ? level : Logger::lineLevel(data, len)) <= Logger::DEBUG;
+}
+
+void AsyncLogging::countDropped(int len)
+{
+    droppedLines_.fetch_add(1, std::memory_order_relaxed);
+    droppedBytes_.fetch_add(static_cast<uint64_t>(len), std::memory_order_relaxed);
+}
+
+AsyncLogging::BufferPtr AsyncLogging::takeFreeBufferLocked()
+{
+    BufferPtr buffer;
+    if (!freeBuffers_.empty())
+    {
+        buffer = std::move(freeBuffers_.back());
+        freeBuffers_.pop_back();
+    }
+    else if (allocatedBuffers_ < maxQueuedBuffers_ + 3) // 排队的, currentBuffer_, 后端正在写的和一个备用
+    {
+        buffer.reset(new LargeBuffer);
+        ++allocatedBuffers_;
+    }
+    return buffer;
+}
+
+void AsyncLogging::reportDropped(LogFile &output)
+{
+    uint64_t dropped = droppedLines_.load(std::memory_order_relaxed);
+    if (dropped == reportedDroppedLines_)
+    {
+        return;
+    }
+    Timestamp now = Timestamp::now();
+    char line[256];
+    int len = snprintf(line, sizeof(line), "%s WARN  AsyncLogging dropped %llu log lines, %llu lines %llu bytes in total - AsyncLogging.cc\n",
+                       now.toFormattedString(true).c_str(),
+                       static_cast<unsigned long long>(dropped - reportedDroppedLines_),
+                       static_cast<unsigned long long>(dropped),
+                       static_cast<unsigned long long>(droppedBytes_.load(std::memory_order_relaxed)));
+    if (binary_)
+    {
+        BinaryLog::RecordHeader header = {BinaryLog::kTextFormatId, static_cast<uint32_t>(sizeof(header) + len), 0};
+        output.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    }
+    output.append(line, len);
+    reportedDroppedLines_ = dropped;
+}
+
+void AsyncLogging::writeDictionary(LogFile &output)
+{
+    if (!binary_)
+    {
+        return;
+    }
+    uint32_t count = BinaryLog::formatCount();
+    if (count == dictionaryWritten_)
+    {
+        return;
+    }
+    std::string dictionary;
+    BinaryLog::appendDictionary(dictionaryWritten_ + 1, count, &dictionary);
+    dictionaryWritten_ = count;
+    output.append(dictionary.data(), static_cast<int>(dictionary.size()));
+}
+
+StagingBuffer *AsyncLogging::threadBuffer()
+{
+    StagingBuffer *buffer = nullptr;
+    for (auto &registered : t_stagings.buffers)
+    {
+        if (registered.first == id_)
+        {
+            buffer = registered.second.get();
+            break;
+        }
+    }
+    if (!buffer)
+    {
+        auto created = std::make_shared<StagingBuffer>(threadBufferSize_);
+        buffer = created.get();
+        t_stagings.buffers.emplace_back(id_, created);
+        std::lock_guard<std::mutex> lg(stagingMutex_);
+        stagings_.push_back(std::move(created));
+    }
+    t_lastOwner = id_;
+    t_lastBuffer = buffer;
+    return buffer;
+}
+
+void AsyncLogging::waitForStagingWriters()
+{
+    std::vector<std::shared_ptr<StagingBuffer>> stagings;
+    {
+        std::lock_guard<std::mutex> lg(stagingMutex_);
+        stagings = stagings_;
+    }
+    for (auto &staging : stagings)
+    {
+        while (staging->writing())
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void AsyncLogging::drainStagings(LogFile &output)
+{
+    std::vector<std::shared_ptr<StagingBuffer>> stagings;
+    {
+        std::lock_guard<std::mutex> lg(stagingMutex_);
+        stagings = stagings_;
+    }
+
+    const char *first;
+    const char *second;
+    size_t firstLen;
+    size_t secondLen;
+    if (mergeByTime_)
+    {
+        mergeScratch_.resize(stagings.size());
+        for (size_t i = 0; i < stagings.size(); ++i)
+        {
+            size_t readable = stagings[i]->peek(&first, &firstLen, &second, &secondLen);
+            mergeScratch_[i].assign(first, firstLen);
+            mergeScratch_[i].append(second, secondLen);
+            stagings[i]->consume(readable);
+        }
+        writeDictionary(output);
+        writeMerged(output);
+    }
+    else
+    {
+        // 先取出所有线程的日志再写字典, 保证这些记录用到的格式都已经写入
+        std::vector<size_t> readable(stagings.size());
+        for (size_t i = 0; i < stagings.size(); ++i)
+        {
+            readable[i] = stagings[i]->peek(&first, &firstLen, &second, &secondLen);
+        }
+        writeDictionary(output);
+        // 每个线程的日志是一段或两段连续的完整日志行, 直接写入文件
+        for (size_t i = 0; i < stagings.size(); ++i)
+        {
+            if (readable[i] == 0)
+            {
+                continue;
+            }
+            stagings[i]->peek(&first, &firstLen, &second, &secondLen);
+            // 取出之后可能又有新的日志, 只写取出时的部分
+            firstLen = firstLen < readable[i] ? firstLen : readable[i];
+            secondLen = readable[i] - firstLen;
+            output.append(first, static_cast<int>(firstLen));
+            if (secondLen > 0)
+            {
+                output.append(second, static_cast<int>(secondLen));
+            }
+            stagings[i]->consume(readable[i]);
+        }
+    }
+
+    // 线程退出后它的缓冲区不会再写入, 写完就可以释放
+    bool anyRetired = false;
+    for (auto &staging : stagings)
+    {
+        anyRetired = anyRetired || (staging->retired() && staging->size() == 0);
+    }
+    if (anyRetired)
+    {
+        std::lock_guard<std::mutex> lg(stagingMutex_);
+        stagings_.erase(std::remove_if(stagings_.begin(), stagings_.end(),
+                                       [](const std::shared_ptr<StagingBuffer> &staging)
+                                       { return staging->retired() && staging->size() == 0; }),
+                        stagings_.end());
+    }
+}
+
+// 多路归并各线程本次取出的日志, 每次输出写入时间最早的一行
+void AsyncLogging::writeMerged(LogFile &output)
+{
+    std::vector<size_t> positions(mergeScratch_.size(), 0);
+    std::string &merged = mergeOutput_;
+    merged.clear();
+    while (true)
+    {
+        int earliest = -1;
+        int64_t earliestTime = 0;
+        for (size_t i = 0; i < mergeScratch_.size(); ++i)
+        {
+            if (positions[i] + kRecordHeaderSize > mergeScratch_[i].size())
+            {
+                continue;
+            }
+            int64_t time;
+            memcpy(&time, mergeScratch_[i].data() + positions[i], sizeof(time));
+            if (earliest < 0 || time < earliestTime)
+            {
+                earliest = static_cast<int>(i);
+                earliestTime = time;
+            }
+        }
+        if (earliest < 0)
+        {
+            break;
+        }
+        const std::string &records = mergeScratch_[earliest];
+        uint32_t length;
+        memcpy(&length, records.data() + positions[earliest] + sizeof(int64_t), sizeof(length));
+        if (merged.size() + length > static_cast<size_t>(kLargeBufferSize))
+        {
+            output.append(merged.data(), static_cast<int>(merged.size()));
+            merged.clear();
+        }
+        merged.append(records.data() + positions[earliest] + kRecordHeaderSize, length);
+        positions[earliest] += kRecordHeaderSize + length;
+    }
+    if (!merged.empty())
+    {
+        output.append(merged.data(), static_cast<int>(merged.size()));
     }
 }
 
 void AsyncLogging::threadFunc()
 {
     // output写入磁盘接口
-    LogFile output(basename_, rollSize_);
-    BufferPtr newbuffer1(new LargeBuffer); // 生成新buffer替换currentbuffer_
-    BufferPtr newbuffer2(new LargeBuffer); // 生成新buffer2替换newBuffer_，其目的是为了防止后端缓冲区全满前端无法写入
-    newbuffer1->bzero();
-    newbuffer2->bzero();
-    // 缓冲区数组置为16个，用于和前端缓冲区数组进行交换
+    LogFile output(basename_, rollSize_, flushInterval_, 1024, binary_ ? ".blog" : ".log", fileOptions_);
+    if (binary_)
+    {
+        // 每个二进制日志文件以完整的格式字典开头, 单独一个文件也能解码
+        output.setFileHeader([this]
+                             {
+                                 std::string header(BinaryLog::kFileMagic, sizeof(BinaryLog::kFileMagic));
+                                 uint32_t count = BinaryLog::formatCount();
+                                 BinaryLog::appendDictionary(1, count, &header);
+                                 dictionaryWritten_ = count;
+                                 return header; });
+    }
+    // 用于和前端缓冲区队列进行交换, 写完后缓冲区放回空闲池
     BufferVector buffersToWrite;
     buffersToWrite.reserve(16);
-    while (running_)
+    bool stopping = false;
+    while (!stopping)
     {
         {
             // 互斥锁保护这样就保证了其他前端线程无法向前端buffer写入数据
             std::unique_lock<std::mutex> lg(mutex_);
-            if (buffers_.empty())
+            if (buffers_.empty() && running_)
             {
-                cond_.wait_for(lg, std::chrono::seconds(3));
+                // 共享缓冲区写满, 某个线程的StagingBuffer积压过半, 或者stop()时被唤醒, 否则每flushInterval_秒写一次
+                cond_.wait_for(lg, std::chrono::seconds(flushInterval_), [this]
+                               { return !buffers_.empty() || stagingFull_.load(std::memory_order_relaxed) || !running_; });
             }
-            buffers_.push_back(std::move(currentBuffer_));
-            currentBuffer_ = std::move(newbuffer1);
-            if (!nextBuffer_)
+            // running_在锁内修改, 停止时这是最后一轮, 写完剩下的日志
+            stopping = !running_;
+            if (stopping)
             {
-                nextBuffer_ = std::move(newbuffer2);
+                // 已经看到running_为true的前端线程可能还在写, 等它们写完, 写共享缓冲区需要这把锁
+                lg.unlock();
+                waitForStagingWriters();
+                lg.lock();
+            }
+            stagingFull_.store(false, std::memory_order_relaxed);
+            if (currentBuffer_->length() > 0)
+            {
+                BufferPtr buffer = takeFreeBufferLocked();
+                if (buffer)
+                {
+                    buffers_.push_back(std::move(currentBuffer_));
+                    currentBuffer_ = std::move(buffer);
+                }
             }
             buffersToWrite.swap(buffers_);
         }
+        writeDictionary(output);
         // 从待写缓冲区取出数据通过LogFile提供的接口写入到磁盘中
         for (auto &buffer : buffersToWrite)
         {
             output.append(buffer->data(), buffer->length());
+            buffer->reset();
         }
+        // 各线程StagingBuffer中的日志
+        drainStagings(output);
+        reportDropped(output);
 
-        if (buffersToWrite.size() > 2)
-        {
-            buffersToWrite.resize(2);
-        }
-
-        if (!newbuffer1)
+        // 归还缓冲区并持锁之后再通知, StagingBuffer腾出的空间也由这次通知告知等待的前端
         {
-            newbuffer1 = std::move(buffersToWrite.back());
-            buffersToWrite.pop_back();
-            newbuffer1->reset();
-        }
-        if (!newbuffer2)
-        {
-            newbuffer2 = std::move(buffersToWrite.back());
-            buffersToWrite.pop_back();
-            newbuffer2->reset();
+            std::lock_guard<std::mutex> lg(mutex_);
+            for (auto &buffer : buffersToWrite)
+            {
+                freeBuffers_.push_back(std::move(buffer));
+            }
         }
-        buffersToWrite.clear(); // 清空后端缓冲队列
-        output.flush();         // 清空文件夹缓冲区
+        buffersToWrite.clear();
+        spaceCond_.notify_all();
+        output.flush(); // 清空文件夹缓冲区
     }
-    output.flush(); // 确保一定清空。
-}
\ No newline at end of file
+}
@@ -0,0 +1,340 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <time.h>
+
+#include <deque>
+#include <mutex>
+
+#include "BinaryLog.h"
+
+const char BinaryLog::kFileMagic[8] = {'R', 'A', 'I', 'N', 'B', 'L', 'G', '1'};
+
+namespace
+{
+    // 已注册的格式, 编号为下标加1, 注册后不再修改
+    std::mutex g_formatMutex;
+    std::deque<BinaryLog::Format> g_formats;
+    std::atomic<uint32_t> g_formatCount(0);
+
+    // 没有设置输出时渲染成文本, 交给Logger的输出函数
+    void defaultOutput(const char *record, int len, Logger::LogLevel)
+    {
+        std::string line;
+        if (BinaryLog::formatRecord(record, len, &line))
+        {
+            Logger::output(line.data(), static_cast<int>(line.size()));
+        }
+    }
+    BinaryLog::OutputFunc g_binaryOutput = defaultOutput;
+
+    template <typename T>
+    bool readValue(const char *data, size_t len, size_t *pos, T *value)
+    {
+        if (*pos + sizeof(T) > len)
+        {
+            return false;
+        }
+        memcpy(value, data + *pos, sizeof(T));
+        *pos += sizeof(T);
+        return true;
+    }
+
+    bool readString(const char *data, size_t len, size_t *pos, std::string *value)
+    {
+        uint32_t size;
+        if (!readValue(data, len, pos, &size) || *pos + size > len)
+        {
+            return false;
+        }
+        value->assign(data + *pos, size);
+        *pos += size;
+        return true;
+    }
+
+    void appendString(std::string *out, const std::string &value)
+    {
+        uint32_t size = static_cast<uint32_t>(value.size());
+        out->append(reinterpret_cast<const char *>(&size), sizeof(size));
+        out->append(value);
+    }
+
+    void appendFormatted(std::string *out, const char *spec, ...) __attribute__((format(printf, 2, 3)));
+    void appendFormatted(std::string *out, const char *spec, ...)
+    {
+        char buf[256];
+        va_list args;
+        va_start(args, spec);
+        int n = vsnprintf(buf, sizeof(buf), spec, args);
+        va_end(args);
+        if (n < 0)
+        {
+            return;
+        }
+        if (static_cast<size_t>(n) < sizeof(buf))
+        {
+            out->append(buf, n);
+            return;
+        }
+        std::string large(n + 1, '\0');
+        va_start(args, spec);
+        vsnprintf(&large[0], large.size(), spec, args);
+        va_end(args);
+        out->append(large.data(), n);
+    }
+
+    // 渲染一个参数, spec是去掉了长度修饰符的转换说明(不含转换字符), 长度修饰符按记录中的类型重新加上
+    bool appendArg(std::string *out, std::string spec, char conversion, char type, const char *args, size_t len, size_t *pos)
+    {
+        const bool integerConversion = strchr("diouxXc", conversion) != nullptr;
+        const bool floatConversion = strchr("fFeEgGaA", conversion) != nullptr;
+        switch (type)
+        {
+        case 'i':
+        case 'I':
+        case 'l':
+        case 'L':
+        {
+            long long value = 0;
+            if (type == 'i' || type == 'I')
+            {
+                int32_t v;
+                if (!readValue(args, len, pos, &v))
+                {
+                    return false;
+                }
+                value = type == 'i' ? static_cast<long long>(v) : static_cast<long long>(static_cast<uint32_t>(v));
+            }
+            else if (!readValue(args, len, pos, &value))
+            {
+                return false;
+            }
+            if (conversion == 'c')
+            {
+                appendFormatted(out, (spec + 'c').c_str(), static_cast<int>(value));
+            }
+            else if (integerConversion)
+            {
+                appendFormatted(out, (spec + "ll" + conversion).c_str(), value);
+            }
+            else if (floatConversion)
+            {
+                appendFormatted(out, (spec + conversion).c_str(), static_cast<double>(value));
+            }
+            else
+            {
+                appendFormatted(out, type == 'L' ? "%llu" : "%lld", value);
+            }
+            return true;
+        }
+        case 'd':
+        {
+            double value;
+            if (!readValue(args, len, pos, &value))
+            {
+                return false;
+            }
+            if (floatConversion)
+            {
+                appendFormatted(out, (spec + conversion).c_str(), value);
+            }
+            else if (integerConversion && conversion != 'c')
+            {
+                appendFormatted(out, (spec + "ll" + conversion).c_str(), static_cast<long long>(value));
+            }
+            else
+            {
+                appendFormatted(out, "%g", value);
+            }
+            return true;
+        }
+        case 's':
+        {
+            std::string value;
+            if (!readString(args, len, pos, &value))
+            {
+                return false;
+            }
+            if (conversion == 's')
+            {
+                appendFormatted(out, (spec + 's').c_str(), value.c_str());
+            }
+            else
+            {
+                out->append(value);
+            }
+            return true;
+        }
+        case 'p':
+        {
+            uint64_t value;
+            if (!readValue(args, len, pos, &value))
+            {
+                return false;
+            }
+            if (conversion == 'p')
+            {
+                appendFormatted(out, (spec + 'p').c_str(), reinterpret_cast<void *>(static_cast<uintptr_t>(value)));
+            }
+            else
+            {
+                appendFormatted(out, "0x%llx", static_cast<unsigned long long>(value));
+            }
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+}
+
+void BinaryLog::setOutput(OutputFunc out)
+{
+    g_binaryOutput = out;
+}
+
+void BinaryLog::output(const char *record, int len, Logger::LogLevel level)
+{
+    g_binaryOutput(record, len, level);
+}
+
+uint32_t BinaryLog::registerFormat(Logger::LogLevel level, const char *file, int line, const char *format, const char *argTypes)
+{
+    std::lock_guard<std::mutex> lock(g_formatMutex);
+    Format registered;
+    registered.id = static_cast<uint32_t>(g_formats.size() + 1);
+    registered.level = level;
+    registered.line = line;
+    SourceFile source(file);
+    registered.file.assign(source.data_, source.size_);
+    registered.format = format;
+    registered.argTypes = argTypes;
+    g_formats.push_back(std::move(registered));
+    g_formatCount.store(static_cast<uint32_t>(g_formats.size()), std::memory_order_release);
+    return g_formats.back().id;
+}
+
+uint32_t BinaryLog::formatCount()
+{
+    return g_formatCount.load(std::memory_order_acquire);
+}
+
+void BinaryLog::appendDictionary(uint32_t firstId, uint32_t lastId, std::string *out)
+{
+    std::lock_guard<std::mutex> lock(g_formatMutex);
+    for (uint32_t id = firstId; id <= lastId && id <= g_formats.size(); ++id)
+    {
+        const Format &format = g_formats[id - 1];
+        const size_t start = out->size();
+        RecordHeader header = {kDictionaryId, 0, 0};
+        out->append(reinterpret_cast<const char *>(&header), sizeof(header));
+        int32_t fields[3] = {static_cast<int32_t>(format.id), format.level, format.line};
+        out->append(reinterpret_cast<const char *>(fields), sizeof(fields));
+        appendString(out, format.file);
+        appendString(out, format.format);
+        appendString(out, format.argTypes);
+        // 补上记录长度
+        uint32_t length = static_cast<uint32_t>(out->size() - start);
+        memcpy(&(*out)[start] + offsetof(RecordHeader, length), &length, sizeof(length));
+    }
+}
+
+bool BinaryLog::parseDictionary(const char *payload, size_t len, Format *format)
+{
+    size_t pos = 0;
+    int32_t fields[3];
+    if (!readValue(payload, len, &pos, &fields))
+    {
+        return false;
+    }
+    format->id = static_cast<uint32_t>(fields[0]);
+    format->level = fields[1];
+    format->line = fields[2];
+    return format->level >= Logger::TRACE && format->level < Logger::LEVEL_COUNT &&
+           readString(payload, len, &pos, &format->file) &&
+           readString(payload, len, &pos, &format->format) &&
+           readString(payload, len, &pos, &format->argTypes);
+}
+
+bool BinaryLog::formatRecord(const Format &format, int64_t time, const char *args, size_t len, std::string *out)
+{
+    // 与Logger相同的行格式: 时间 等级 内容 - 文件:行号
+    time_t seconds = static_cast<time_t>(time / Timestamp::kMicroSecondsPerSecond);
+    struct tm tm_time;
+    localtime_r(&seconds, &tm_time);
+    appendFormatted(out, "%4d/%02d/%02d %02d:%02d:%02d.%06d ",
+                    tm_time.tm_year + 1900, tm_time.tm_mon + 1, tm_time.tm_mday,
+                    tm_time.tm_hour, tm_time.tm_min, tm_time.tm_sec,
+                    static_cast<int>(time % Timestamp::kMicroSecondsPerSecond));
+    out->append(Logger::levelName(static_cast<Logger::LogLevel>(format.level)));
+
+    bool complete = true;
+    size_t pos = 0;
+    size_t nextArg = 0;
+    const std::string &fmt = format.format;
+    for (size_t i = 0; i < fmt.size(); ++i)
+    {
+        if (fmt[i] != '%')
+        {
+            out->push_back(fmt[i]);
+            continue;
+        }
+        if (i + 1 < fmt.size() && fmt[i + 1] == '%')
+        {
+            out->push_back('%');
+            ++i;
+            continue;
+        }
+        // %[flags][width][.precision][length]conversion, 长度修饰符去掉
+        std::string spec("%");
+        size_t j = i + 1;
+        while (j < fmt.size() && strchr("-+ #0'123456789.", fmt[j]) != nullptr)
+        {
+            spec.push_back(fmt[j++]);
+        }
+        while (j < fmt.size() && strchr("hljztLq", fmt[j]) != nullptr)
+        {
+            ++j;
+        }
+        if (j >= fmt.size())
+        {
+            out->append(fmt, i, std::string::npos);
+            break;
+        }
+        i = j;
+        if (nextArg >= format.argTypes.size() ||
+            !appendArg(out, spec, fmt[j], format.argTypes[nextArg++], args, len, &pos))
+        {
+            out->append("<?>");
+            complete = false;
+        }
+    }
+    out->append(" - ");
+    out->append(format.file);
+    appendFormatted(out, ":%d\n", format.line);
+    return complete;
+}
+
+bool BinaryLog::formatRecord(const char *record, int len, std::string *out)
+{
+    RecordHeader header;
+    if (len < static_cast<int>(sizeof(header)))
+    {
+        return false;
+    }
+    memcpy(&header, record, sizeof(header));
+    if (header.formatId == kTextFormatId)
+    {
+        out->append(record + sizeof(header), len - sizeof(header));
+        return true;
+    }
+    Format format;
+    {
+        std::lock_guard<std::mutex> lock(g_formatMutex);
+        if (header.formatId == 0 || header.formatId > g_formats.size())
+        {
+            return false;
+        }
+        format = g_formats[header.formatId - 1];
+    }
+    return formatRecord(format, header.time, record + sizeof(header), len - sizeof(header), out);
+}
@@ -1,50 +1,262 @@
 #include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <new>
 #include "FileUtil.h"
 
-FileUtil::FileUtil(std::string &file_name) : file_(::fopen(file_name.c_str(), "ae")),
-                                             writtenBytes_(0)
+namespace
 {
-    // 将file_缓冲区设置为本地缓冲降低io次数。
-    ::setbuffer(file_, buffer_, sizeof(buffer_));
+    int64_t nowMs()
+    {
+        struct timespec ts;
+        ::clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+    }
+}
+
+FileUtil::FileUtil(std::string &file_name, const Options &options) : fd_(-1),
+                                                                     tailFd_(-1),
+                                                                     directIO_(options.directIO),
+                                                                     preallocated_(0),
+                                                                     syncPolicy_(options.syncPolicy),
+                                                                     syncEvery_(options.syncEvery),
+                                                                     buffer_(nullptr),
+                                                                     bufferLen_(0),
+                                                                     bufferOffset_(0),
+                                                                     unsyncedBytes_(0),
+                                                                     tailCounted_(0),
+                                                                     lastSyncMs_(nowMs()),
+                                                                     writtenBytes_(0)
+{
+    // O_DIRECT要求内存地址对齐
+    if (::posix_memalign(reinterpret_cast<void **>(&buffer_), kAlignment, kBufferSize) != 0)
+    {
+        throw std::bad_alloc();
+    }
+    // 不用O_APPEND, 否则pwrite会忽略偏移
+    const int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+    if (directIO_)
+    {
+        // tmpfs等文件系统不支持O_DIRECT, 打开失败时使用普通写入
+        fd_ = ::open(file_name.c_str(), flags | O_DIRECT, 0666);
+        if (fd_ >= 0)
+        {
+            tailFd_ = ::open(file_name.c_str(), flags, 0666);
+        }
+        if (tailFd_ < 0)
+        {
+            disableDirectIO();
+        }
+    }
+    if (fd_ < 0)
+    {
+        fd_ = ::open(file_name.c_str(), flags, 0666);
+    }
+    if (fd_ < 0)
+    {
+        fprintf(stderr, "FileUtil::FileUtil() open %s failed %s\n", file_name.c_str(), strerror(errno));
+        return;
+    }
+
+    // 文件已经存在时接在末尾写入, O_DIRECT时从最后一个对齐块开始, 先读入块中已有的内容
+    struct stat st;
+    const off_t size = ::fstat(fd_, &st) == 0 ? st.st_size : 0;
+    bufferOffset_ = size;
+    if (directIO_)
+    {
+        bufferOffset_ = size / kAlignment * kAlignment;
+        bufferLen_ = static_cast<size_t>(size - bufferOffset_);
+        if (bufferLen_ > 0)
+        {
+            int readFd = ::open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+            if (readFd < 0 || ::pread(readFd, buffer_, bufferLen_, bufferOffset_) != static_cast<ssize_t>(bufferLen_))
+            {
+                disableDirectIO();
+                bufferOffset_ = size;
+                bufferLen_ = 0;
+            }
+            if (readFd >= 0)
+            {
+                ::close(readFd);
+            }
+        }
+    }
+
+    // 预分配失败(比如文件系统不支持)不影响写入
+    if (options.preallocate > 0 && ::fallocate(fd_, FALLOC_FL_KEEP_SIZE, size, options.preallocate) == 0)
+    {
+        preallocated_ = size + options.preallocate;
+    }
 }
 FileUtil::~FileUtil()
 {
-    if (file_)
+    if (fd_ >= 0)
+    {
+        writeBuffer();
+        writeTail();
+        if (syncPolicy_ != kSyncNever && unsyncedBytes_ > 0)
+        {
+            sync();
+        }
+        // 截断到当前长度, 释放文件末尾之后没有用到的预分配空间
+        const off_t end = bufferOffset_ + static_cast<off_t>(bufferLen_);
+        if (preallocated_ > end && ::ftruncate(fd_, end) != 0)
+        {
+            fprintf(stderr, "FileUtil::~FileUtil() ftruncate failed %s\n", strerror(errno));
+        }
+        ::close(fd_);
+    }
+    if (tailFd_ >= 0)
     {
-        ::fclose(file_);
+        ::close(tailFd_);
     }
+    ::free(buffer_);
 }
 // 向文件写入数据
 void FileUtil::append(const char *data, size_t len)
 {
-    size_t writen = 0;
-    while (writen != len)
+    writtenBytes_ += len;
+    while (len > 0)
     {
-        size_t remain = len - writen;
-        size_t n = write(data + writen, remain);
-        if (n != remain)
+        if (bufferLen_ == 0 && !directIO_ && len >= kBufferSize)
         {
-            // 错误判断
-            int err = ferror(file_);
-            if (err)
+            // 不小于缓冲区的数据直接写入, 省一次拷贝
+            if (writeAt(fd_, data, len, bufferOffset_))
             {
-                fprintf(stderr, "AppendFile::append() failed %s\n", strerror(err));
-                clearerr(file_); //  清除文件指针的错误标志
-                break;
+                bufferOffset_ += len;
+                unsyncedBytes_ += len;
+                maybeSync(false);
             }
+            return;
+        }
+        size_t n = len < kBufferSize - bufferLen_ ? len : kBufferSize - bufferLen_;
+        memcpy(buffer_ + bufferLen_, data, n);
+        bufferLen_ += n;
+        data += n;
+        len -= n;
+        if (bufferLen_ == kBufferSize)
+        {
+            writeBuffer();
         }
-        writen += n;
     }
-    writtenBytes_ += writen;
 }
 
 void FileUtil::flush()
 {
-    ::fflush(file_);
+    writeBuffer();
+    writeTail();
+    maybeSync(true);
+}
+
+// O_DIRECT时不足一个对齐块的尾部通过tailFd_写入, 仍然留在缓冲区, 凑满后再整块写一次
+// 每次flush都会重写同一个尾部, 只有上次尾部写入之后追加的字节才计入unsyncedBytes_
+void FileUtil::writeTail()
+{
+    if (bufferLen_ > 0 && writeAt(tailFd_, buffer_, bufferLen_, bufferOffset_))
+    {
+        unsyncedBytes_ += bufferLen_ - tailCounted_;
+        tailCounted_ = bufferLen_;
+    }
+}
+
+void FileUtil::writeBuffer()
+{
+    size_t len = directIO_ ? bufferLen_ / kAlignment * kAlignment : bufferLen_;
+    if (len == 0)
+    {
+        return;
+    }
+    bool written = writeAt(fd_, buffer_, len, bufferOffset_);
+    if (!written && directIO_ && errno == EINVAL)
+    {
+        // 文件系统接受了O_DIRECT但不支持这种对齐, 改用普通写入
+        disableDirectIO();
+        len = bufferLen_;
+        written = writeAt(fd_, buffer_, len, bufferOffset_);
+    }
+    // 写入失败的数据丢弃, 文件偏移不变, 不在文件中留下空洞
+    // 已由尾部写入计数过的字节不再计入
+    const size_t counted = len < tailCounted_ ? len : tailCounted_;
+    if (written)
+    {
+        bufferOffset_ += len;
+        unsyncedBytes_ += len - counted;
+    }
+    tailCounted_ -= counted;
+    bufferLen_ -= len;
+    memmove(buffer_, buffer_ + len, bufferLen_);
+    maybeSync(false);
 }
-// 真正向文件写入数据
-size_t FileUtil::write(const char *data, size_t len)
+
+bool FileUtil::writeAt(int fd, const char *data, size_t len, off_t offset)
 {
-    // 没用选择线程安全的fwrite()为性能考虑。
-   return  ::fwrite_unlocked(data, 1, len, file_);
-}
\ No newline at end of file
+    if (fd < 0)
+    {
+        return false;
+    }
+    size_t written = 0;
+    while (written < len)
+    {
+        ssize_t n = ::pwrite(fd, data + written, len - written, offset + written);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            int err = errno;
+            if (!(directIO_ && err == EINVAL))
+            {
+                fprintf(stderr, "FileUtil::append() failed %s\n", strerror(err));
+            }
+            errno = err;
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void FileUtil::disableDirectIO()
+{
+    if (fd_ >= 0)
+    {
+        int flags = ::fcntl(fd_, F_GETFL);
+        ::fcntl(fd_, F_SETFL, flags & ~O_DIRECT);
+    }
+    if (tailFd_ >= 0)
+    {
+        ::close(tailFd_);
+        tailFd_ = -1;
+    }
+    directIO_ = false;
+}
+
+void FileUtil::maybeSync(bool interval)
+{
+    if (unsyncedBytes_ == 0)
+    {
+        return;
+    }
+    if ((syncPolicy_ == kSyncEveryBytes && unsyncedBytes_ >= syncEvery_) ||
+        (syncPolicy_ == kSyncInterval && interval && nowMs() - lastSyncMs_ >= syncEvery_))
+    {
+        sync();
+    }
+}
+
+void FileUtil::sync()
+{
+    // 只同步数据和读取数据需要的元数据(文件长度、块映射), 不写修改时间等
+    if (::fdatasync(fd_) != 0)
+    {
+        fprintf(stderr, "FileUtil::sync() failed %s\n", strerror(errno));
+    }
+    unsyncedBytes_ = 0;
+    lastSyncMs_ = nowMs();
+}
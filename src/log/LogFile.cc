@@ -3,10 +3,16 @@
 LogFile::LogFile(const std::string &basename,
                  off_t rollsize,
                  int flushInterval,
-                 int checkEveryN) : basename_(basename),
+                 int checkEveryN,
+                 const std::string &suffix,
+                 const FileUtil::Options &options) : basename_(basename),
+                                    suffix_(suffix),
                                     rollsize_(rollsize),
                                     flushInterval_(flushInterval),
                                     checkEveryN_(checkEveryN),
+                                    options_(options),
+                                    count_(0),
+                                    now_(0),
                                     startOfPeriod_(0),
                                     lastRoll_(0),
                                     lastFlush_(0)
@@ -20,29 +26,52 @@ void LogFile::append(const char *data, int len)
     std::lock_guard<std::mutex> lg(mutex_);
     appendInlock(data, len);
 }
+void LogFile::setFileHeader(const std::function<std::string()> &header)
+{
+    std::lock_guard<std::mutex> lg(mutex_);
+    header_ = header;
+    if (header_ && file_->writtenBytes() == 0)
+    {
+        std::string content = header_();
+        file_->append(content.data(), content.size());
+    }
+}
 void LogFile::flush()
 {
+    std::lock_guard<std::mutex> lg(mutex_);
+    now_ = ::time(NULL);
+    if (now_ / kRollPerSeconds_ * kRollPerSeconds_ != startOfPeriod_)
+    {
+        rollFile();
+    }
+    lastFlush_ = now_;
     file_->flush();
 }
 // 滚动日志
 bool LogFile::rollFile()
 {
     time_t now = 0;
-    std::string filename = getLogFileName(basename_, &now);
+    std::string filename = getLogFileName(basename_, suffix_, &now);
     time_t start = now / kRollPerSeconds_ * kRollPerSeconds_;
+    now_ = now;
     if (now > lastRoll_)
     {
         lastFlush_ = now;
         lastRoll_ = now;
         startOfPeriod_ = start;
         // 让file_指向一个名为filename的文件，相当于新建了一个文件，但是rollfile一次就会创建一共file对象去将数据写到日志文件中
-        file_.reset(new FileUtil(filename));
+        file_.reset(new FileUtil(filename, options_));
+        if (header_)
+        {
+            std::string content = header_();
+            file_->append(content.data(), content.size());
+        }
         return true;
     }
     return false;
 }
-// 日志格式basename+now+".log"
-std::string LogFile::getLogFileName(const std::string &basename, time_t *now)
+// 日志格式basename+now+suffix
+std::string LogFile::getLogFileName(const std::string &basename, const std::string &suffix, time_t *now)
 {
     std::string filename;
     filename.reserve(basename.size() + 64);
@@ -55,14 +84,12 @@ std::string LogFile::getLogFileName(const std::string &basename, time_t *now)
     strftime(timebuf, sizeof(timebuf), ".%Y%m%d-%H%M%S", &tm);
 
     filename += timebuf;
-    filename += ".log";
+    filename += suffix;
     return filename;
 }
 void LogFile::appendInlock(const char *data, int len)
 {
     file_->append(data, len);
-
-    time_t now = time(NULL); // 当前时间
     ++count_;
 
     // 1. 判断是否需要滚动日志
@@ -70,22 +97,23 @@ void LogFile::appendInlock(const char *data, int len)
     {
         rollFile();
     }
-    else if (count_ >= checkEveryN_) // 达到写入次数阈值后，进行检查
+    else if (count_ >= checkEveryN_) // 达到写入次数阈值后，更新时间并检查
     {
         count_ = 0;
+        now_ = ::time(NULL);
 
         // 基于时间周期滚动日志
-        time_t thisPeriod = now / kRollPerSeconds_ * kRollPerSeconds_;
+        time_t thisPeriod = now_ / kRollPerSeconds_ * kRollPerSeconds_;
         if (thisPeriod != startOfPeriod_)
         {
             rollFile();
         }
     }
 
-    // 2. 判断是否需要刷新日志（独立的刷新逻辑）
-    if (now - lastFlush_ > flushInterval_)
+    // 2. 判断是否需要刷新日志（独立的刷新逻辑），使用缓存的时间，不在每次写入时取时间
+    if (now_ - lastFlush_ > flushInterval_)
     {
-        lastFlush_ = now;
+        lastFlush_ = now_;
         file_->flush();
     }
 }
@@ -1,3 +1,5 @@
+#include <mutex>
+
 #include "Logger.h"
 #include "CurrentThread.h"
 
@@ -21,6 +23,9 @@ const char *getLevelName[Logger::LogLevel::LEVEL_COUNT]{
     "ERROR ",
     "FATAL ",
 };
+// 一行日志开头的时间长度(formatTime写入的日期和微秒), 后面是日志等级
+static const int kLevelOffset = 19 + 8;
+static const int kLevelNameLength = 6;
 /**
  * 默认的日志输出函数
  * 将日志内容写入标准输出流(stdout)
@@ -44,6 +49,22 @@ static void defaultFlush()
 Logger::OutputFunc g_output = defaultOutput;
 Logger::FlushFunc g_flush = defaultFlush;
 
+// 全局等级和各模块的单独设置(-1表示使用全局等级), 修改时加锁, 再写入各模块实际生效的等级
+static std::mutex g_levelMutex;
+static int g_logLevel = Logger::INFO;
+static int g_moduleOverrides[Logger::MODULE_COUNT] = {-1, -1, -1, -1, -1};
+std::atomic<int> Logger::s_moduleLevels_[Logger::MODULE_COUNT] = {{Logger::INFO}, {Logger::INFO}, {Logger::INFO}, {Logger::INFO}, {Logger::INFO}};
+
+void Logger::applyLevels()
+{
+    for (int i = 0; i < Logger::MODULE_COUNT; ++i)
+    {
+        int level = g_moduleOverrides[i] >= 0 ? g_moduleOverrides[i] : g_logLevel;
+        // FATAL之上没有等级, 保证FATAL总能输出
+        s_moduleLevels_[i].store(level > Logger::FATAL ? Logger::FATAL : level, std::memory_order_relaxed);
+    }
+}
+
 Logger::Impl::Impl(Logger::LogLevel level, int savedErrno, const char *filename, int line)
     : time_(Timestamp::now()),
       stream_(),
@@ -54,7 +75,7 @@ Logger::Impl::Impl(Logger::LogLevel level, int savedErrno, const char *filename,
     // 根据时区格式化当前时间字符串, 也是一条log消息的开头
     formatTime();
     // 写入日志等级
-    stream_ << GeneralTemplate(getLevelName[level], 6);
+    stream_ << GeneralTemplate(getLevelName[level], kLevelNameLength);
     if (savedErrno != 0)
     {
         stream_ << getErrnoMsg(savedErrno) << " (errno=" << savedErrno << ") ";
@@ -63,29 +84,32 @@ Logger::Impl::Impl(Logger::LogLevel level, int savedErrno, const char *filename,
 // 根据时区格式化当前时间字符串, 也是一条log消息的开头
 void Logger::Impl::formatTime()
 {
-    Timestamp now = Timestamp::now();
     //计算秒数
-    time_t seconds = static_cast<time_t>(now.microSecondsSinceEpoch() / Timestamp::kMicroSecondsPerSecond);
-    int microseconds = static_cast<int>(now.microSecondsSinceEpoch() % Timestamp::kMicroSecondsPerSecond);
+    time_t seconds = static_cast<time_t>(time_.microSecondsSinceEpoch() / Timestamp::kMicroSecondsPerSecond);
     //计算剩余微秒数
-    struct tm *tm_timer = localtime(&seconds);
-    // 写入此线程存储的时间buf中
-    snprintf(ThreadInfo::t_timer, sizeof(ThreadInfo::t_timer), "%4d/%02d/%02d %02d:%02d:%02d",
-             tm_timer->tm_year + 1900,
-             tm_timer->tm_mon + 1,
-             tm_timer->tm_mday,
-             tm_timer->tm_hour,
-             tm_timer->tm_min,
-             tm_timer->tm_sec);
-    // 更新最后一次时间调用
-    ThreadInfo::t_lastSecond = seconds;
+    int microseconds = static_cast<int>(time_.microSecondsSinceEpoch() % Timestamp::kMicroSecondsPerSecond);
+    // 同一秒内的日志复用本线程上次格式化的结果, 每秒只调用一次localtime_r
+    if (seconds != ThreadInfo::t_lastSecond)
+    {
+        struct tm tm_timer;
+        localtime_r(&seconds, &tm_timer);
+        // 写入此线程存储的时间buf中
+        snprintf(ThreadInfo::t_timer, sizeof(ThreadInfo::t_timer), "%4d/%02d/%02d %02d:%02d:%02d",
+                 tm_timer.tm_year + 1900,
+                 tm_timer.tm_mon + 1,
+                 tm_timer.tm_mday,
+                 tm_timer.tm_hour,
+                 tm_timer.tm_min,
+                 tm_timer.tm_sec);
+        // 更新最后一次时间调用
+        ThreadInfo::t_lastSecond = seconds;
+    }
 
     // muduo使用Fmt格式化整数，这里我们直接写入buf
     char buf[32] = {0};
-    snprintf(buf, sizeof(buf), "%06d ", microseconds);
+    snprintf(buf, sizeof(buf), ".%06d ", microseconds);
 
-    
-    stream_ << GeneralTemplate(ThreadInfo::t_timer, 17) << GeneralTemplate(buf, 7);
+    stream_ << GeneralTemplate(ThreadInfo::t_timer, 19) << GeneralTemplate(buf, kLevelOffset - 19);
 }
 void Logger::Impl::finish()
 {
@@ -117,4 +141,56 @@ void Logger::setOutput(OutputFunc out)
 void Logger::setFlush(FlushFunc flush)
 {
     g_flush = flush;
-}
\ No newline at end of file
+}
+
+void Logger::output(const char *data, int len)
+{
+    g_output(data, len);
+}
+
+const char *Logger::levelName(LogLevel level)
+{
+    return level >= TRACE && level < LEVEL_COUNT ? getLevelName[level] : getLevelName[INFO];
+}
+
+void Logger::setLogLevel(LogLevel level)
+{
+    std::lock_guard<std::mutex> lock(g_levelMutex);
+    g_logLevel = level;
+    applyLevels();
+}
+
+Logger::LogLevel Logger::logLevel()
+{
+    std::lock_guard<std::mutex> lock(g_levelMutex);
+    return static_cast<LogLevel>(g_logLevel);
+}
+
+void Logger::setModuleLogLevel(LogModule module, LogLevel level)
+{
+    std::lock_guard<std::mutex> lock(g_levelMutex);
+    g_moduleOverrides[module] = level;
+    applyLevels();
+}
+
+void Logger::resetModuleLogLevel(LogModule module)
+{
+    std::lock_guard<std::mutex> lock(g_levelMutex);
+    g_moduleOverrides[module] = -1;
+    applyLevels();
+}
+
+Logger::LogLevel Logger::lineLevel(const char *line, int len)
+{
+    if (len >= kLevelOffset + kLevelNameLength)
+    {
+        for (int level = TRACE; level < LEVEL_COUNT; ++level)
+        {
+            if (memcmp(line + kLevelOffset, getLevelName[level], kLevelNameLength) == 0)
+            {
+                return static_cast<LogLevel>(level);
+            }
+        }
+    }
+    return INFO;
+}
@@ -48,7 +48,7 @@ private:
     void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp time)
     {
         std::string msg = buf->retrieveAllAsString();
-        conn->send(msg);
+        conn->send(std::move(msg));
     }
     TcpServer server_;
     EventLoop *loop_;
@@ -0,0 +1,91 @@
+#include "Numa.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace RainMemoPool
+{
+    // mbind的内存策略, 与linux/mempolicy.h一致
+    static const int MPOL_PREFERRED_MODE = 1;
+
+    static thread_local int t_numaNode = 0;
+
+    // 解析"0-3,8-11"形式的列表
+    static std::vector<int> parseList(const std::string &list)
+    {
+        std::vector<int> result;
+        std::stringstream ss(list);
+        std::string range;
+        while (std::getline(ss, range, ','))
+        {
+            if (range.empty() || range[0] < '0' || range[0] > '9')
+                continue;
+            size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int i = first; i <= last; ++i)
+            {
+                result.push_back(i);
+            }
+        }
+        return result;
+    }
+
+    static std::string readLine(const std::string &path)
+    {
+        std::ifstream in(path);
+        std::string line;
+        std::getline(in, line);
+        return line;
+    }
+
+    int Numa::nodeCount()
+    {
+        // 拓扑不会变化, 只读取一次
+        static const int count = []()
+        {
+            std::vector<int> nodes = parseList(readLine("/sys/devices/system/node/online"));
+            return nodes.empty() ? 1 : nodes.back() + 1;
+        }();
+        return count;
+    }
+
+    std::vector<int> Numa::nodeCpus(int node)
+    {
+        std::vector<int> cpus = parseList(readLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+        if (cpus.empty() && node == 0 && nodeCount() == 1)
+        {
+            // 没有NUMA信息时认为所有CPU都在节点0
+            long n = ::sysconf(_SC_NPROCESSORS_ONLN);
+            for (long i = 0; i < n; ++i)
+            {
+                cpus.push_back(static_cast<int>(i));
+            }
+        }
+        return cpus;
+    }
+
+    int Numa::currentNode()
+    {
+        return t_numaNode;
+    }
+
+    void Numa::setCurrentNode(int node)
+    {
+        t_numaNode = node < 0 ? 0 : node;
+    }
+
+    void Numa::bindMemory(void *ptr, size_t size, int node)
+    {
+        if (nodeCount() <= 1 || node < 0 || node >= static_cast<int>(sizeof(unsigned long) * 8))
+            return;
+        unsigned long nodemask = 1UL << node;
+        // 失败只是退回到默认的首次访问策略, 不影响正确性
+        ::syscall(SYS_mbind, ptr, size, MPOL_PREFERRED_MODE, &nodemask, sizeof(nodemask) * 8, 0);
+    }
+
+} // namespace RainMemoPool
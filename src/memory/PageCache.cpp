@@ -133,6 +133,9 @@ namespace RainMemoPool
         if (ptr == MAP_FAILED)
             return nullptr;
 
+        // 页面分配在本实例的NUMA节点上, 清零时首次访问即在该节点分配
+        Numa::bindMemory(ptr, size, node_);
+
         // 清零内存
         memset(ptr, 0, size);
         return ptr;
@@ -2,6 +2,7 @@
 #include <sys/types.h>
 
 #include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 #include "Acceptor.h"
@@ -19,7 +20,7 @@ static int createNonblocking()
 }
 
 Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport)
-    : loop_(loop), acceptSocket_(createNonblocking()), acceptChannel_(loop, acceptSocket_.fd()), listening_(false)
+    : loop_(loop), acceptSocket_(createNonblocking()), acceptChannel_(loop, acceptSocket_.fd()), listening_(false), acceptBatch_(16), backlog_(1024), deferAcceptSeconds_(0), fastOpenQueue_(0), idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC))
 {
     acceptSocket_.setReuseAddr(true);
     acceptSocket_.setReusePort(true);
@@ -32,36 +33,113 @@ Acceptor::~Acceptor()
 {
     acceptChannel_.disableAll(); ///< Remove interest in events from Poller
     acceptChannel_.remove();     ///< Call EventLoop->removeChannel => Poller->removeChannel to remove the corresponding part of the ChannelMap
+    if (idleFd_ >= 0)
+    {
+        ::close(idleFd_);
+    }
 }
 
 void Acceptor::listen()
 {
     listening_ = true;
-    acceptSocket_.listen();         ///< listen a socket
+    if (deferAcceptSeconds_ > 0)
+    {
+        acceptSocket_.setDeferAccept(deferAcceptSeconds_);
+    }
+    if (fastOpenQueue_ > 0)
+    {
+        acceptSocket_.setFastOpen(fastOpenQueue_);
+    }
+    acceptSocket_.listen(backlog_); ///< listen a socket
     acceptChannel_.enableReading(); ///< acceptChannel_ register to Poller !!! important !!!
 }
 
 void Acceptor::handleRead()
 {
-    InetAddress peerAddr;
-    int connfd = acceptSocket_.accept(&peerAddr);
-    if (connfd >= 0)
+    /// Edge triggered: pending connections in the backlog get no more wakeup, accept until EAGAIN
+    const bool drain = acceptChannel_.isEdgeTriggered();
+    bool shed = false;
+    for (int n = 0; drain || n < acceptBatch_; ++n)
     {
-        if (NewConnectionCallback_)
+        InetAddress peerAddr;
+        int connfd = acceptSocket_.accept(&peerAddr);
+        if (connfd >= 0)
         {
-            NewConnectionCallback_(connfd, peerAddr); ///< Poller find subLoop, wake up and dispatch new client Channel
+            accepted_.emplace_back(connfd, peerAddr);
+            if (accepted_.size() >= static_cast<size_t>(acceptBatch_))
+            {
+                dispatchAccepted();
+            }
+            continue;
         }
-        else
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
         {
-            ::close(connfd);
+            break; ///< Backlog drained
         }
+        if (errno == EINTR || errno == ECONNABORTED || errno == EPROTO)
+        {
+            continue; ///< This connection is gone, try the next one
+        }
+        if (errno == EMFILE || errno == ENFILE)
+        {
+            /// Close the connections we can not serve, or the level triggered listen socket stays readable and the loop spins
+            if (!shed)
+            {
+                LOG_ERROR << "Acceptor::handleRead sockfd reached limit, shedding new connections";
+                shed = true;
+            }
+            if (shedConnection())
+            {
+                continue;
+            }
+            break;
+        }
+        LOG_ERROR << "accept Err " << errno;
+        break;
+    }
+    dispatchAccepted();
+}
+
+bool Acceptor::shedConnection()
+{
+    if (idleFd_ < 0)
+    {
+        idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC); ///< Lost the reserve last time, try to get it back
+        return false;
+    }
+    ::close(idleFd_);
+    idleFd_ = ::accept(acceptSocket_.fd(), nullptr, nullptr);
+    if (idleFd_ >= 0)
+    {
+        ::close(idleFd_);
+    }
+    idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    return true;
+}
+
+void Acceptor::dispatchAccepted()
+{
+    if (accepted_.empty())
+    {
+        return;
+    }
+    if (newConnectionsCallback_)
+    {
+        newConnectionsCallback_(accepted_); ///< Poller find subLoops, wake up each once and dispatch new client Channels
     }
     else
     {
-        LOG_ERROR << "accept Err";
-        if (errno == EMFILE)
+        for (auto &item : accepted_)
         {
-            LOG_ERROR << "sockfd reached limit";
+            if (NewConnectionCallback_)
+            {
+                NewConnectionCallback_(item.first, item.second);
+            }
+            else
+            {
+                ::close(item.first);
+            }
         }
     }
-}
\ No newline at end of file
+    accepted_.clear();
+}
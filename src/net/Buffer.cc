@@ -8,7 +8,7 @@
 
 ssize_t Buffer::readFd(int fd, int *saveErrno)
 {
-    char extrabuf[65536] = {0}; ///< Stack memory space 65536/1024 = 64KB
+    char extrabuf[65536]; ///< Stack memory space 65536/1024 = 64KB, no need to zero it, readv only writes
 
     /**
      * struct_iovec.h
@@ -43,7 +43,7 @@ ssize_t Buffer::readFd(int fd, int *saveErrno)
     }
     else
     {
-        writerIndex_ = buffer_.size();
+        writerIndex_ = capacity_;
         append(extrabuf, n - writable);
     }
     return n;
@@ -0,0 +1,146 @@
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "ChainBuffer.h"
+#include "MemoryPool.h"
+
+ChainBuffer::ChainBuffer() : readable_(0)
+{
+}
+
+ChainBuffer::~ChainBuffer()
+{
+    retrieveAll();
+}
+
+void ChainBuffer::append(const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        /// Fill the free space of the tail block first, external slices are read only
+        if (chunks_.empty() || chunks_.back().block == nullptr || chunks_.back().writeIndex == kBlockSize)
+        {
+            Chunk chunk;
+            chunk.block = static_cast<char *>(RainMemoPool::MemoryPool::allocate(kBlockSize));
+            chunk.data = chunk.block;
+            chunk.readIndex = 0;
+            chunk.writeIndex = 0;
+            chunks_.push_back(std::move(chunk));
+        }
+        Chunk &tail = chunks_.back();
+        size_t n = std::min(len, kBlockSize - tail.writeIndex);
+        ::memcpy(tail.block + tail.writeIndex, data, n);
+        tail.writeIndex += n;
+        readable_ += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void ChainBuffer::appendExternal(const char *data, size_t len, std::shared_ptr<const void> owner)
+{
+    if (len == 0)
+    {
+        return;
+    }
+    Chunk chunk;
+    chunk.block = nullptr;
+    chunk.data = data;
+    chunk.readIndex = 0;
+    chunk.writeIndex = len;
+    chunk.owner = std::move(owner);
+    chunks_.push_back(std::move(chunk));
+    readable_ += len;
+}
+
+void ChainBuffer::retrieve(size_t len)
+{
+    if (len >= readable_)
+    {
+        retrieveAll();
+        return;
+    }
+    readable_ -= len;
+    while (len > 0)
+    {
+        Chunk &front = chunks_.front();
+        size_t n = std::min(len, front.writeIndex - front.readIndex);
+        front.readIndex += n;
+        len -= n;
+        if (front.readIndex == front.writeIndex)
+        {
+            release(front);
+            chunks_.pop_front();
+        }
+    }
+}
+
+void ChainBuffer::retrieveAll()
+{
+    for (Chunk &chunk : chunks_)
+    {
+        release(chunk);
+    }
+    chunks_.clear();
+    readable_ = 0;
+}
+
+void ChainBuffer::swap(ChainBuffer &rhs)
+{
+    chunks_.swap(rhs.chunks_);
+    std::swap(readable_, rhs.readable_);
+}
+
+int ChainBuffer::fillIovec(struct iovec *iov, int maxIov) const
+{
+    int n = 0;
+    for (auto it = chunks_.begin(); it != chunks_.end() && n < maxIov; ++it)
+    {
+        iov[n].iov_base = const_cast<char *>(it->data + it->readIndex);
+        iov[n].iov_len = it->writeIndex - it->readIndex;
+        ++n;
+    }
+    return n;
+}
+
+const std::shared_ptr<const void> &ChainBuffer::frontOwner() const
+{
+    static const std::shared_ptr<const void> kNoOwner;
+    return chunks_.empty() ? kNoOwner : chunks_.front().owner;
+}
+
+ssize_t ChainBuffer::writeFd(int fd, int *saveErrno, size_t maxBytes) const
+{
+    struct iovec iov[IOV_MAX];
+    int iovcnt = fillIovec(iov, IOV_MAX);
+    // Cut the iovecs at maxBytes
+    for (int i = 0; i < iovcnt; ++i)
+    {
+        if (iov[i].iov_len >= maxBytes)
+        {
+            iov[i].iov_len = maxBytes;
+            iovcnt = i + 1;
+            break;
+        }
+        maxBytes -= iov[i].iov_len;
+    }
+    ssize_t n = ::writev(fd, iov, iovcnt);
+    if (n < 0)
+    {
+        *saveErrno = errno;
+    }
+    return n;
+}
+
+void ChainBuffer::release(Chunk &chunk)
+{
+    if (chunk.block)
+    {
+        RainMemoPool::MemoryPool::deallocate(chunk.block, kBlockSize);
+        chunk.block = nullptr;
+    }
+    chunk.owner.reset();
+}
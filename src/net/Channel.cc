@@ -7,9 +7,10 @@
 const int Channel::kNoneEvent = 0;
 const int Channel::kReadEvent = EPOLLIN | EPOLLPRI;
 const int Channel::kWriteEvent = EPOLLOUT;
+const int Channel::kEdgeTriggered = EPOLLET;
 
 // EventLoop: ChannelList Poller
-Channel::Channel(EventLoop *loop, int fd) : loop_(loop), fd_(fd), events_(0), revents_(0), index_(-1), tied_(false)
+Channel::Channel(EventLoop *loop, int fd) : loop_(loop), fd_(fd), events_(0), revents_(0), index_(-1), edgeTriggered_(false), tied_(false)
 {
 }
 
@@ -55,7 +56,7 @@ void Channel::handleEvent(Timestamp receiveTime)
 
 void Channel::handleEventWithGuard(Timestamp receiveTime)
 {
-    LOG_INFO << "channel handleEvent revents:" << revents_;
+    LOG_TRACE << "channel handleEvent revents:" << revents_;
 
     // Close
     if ((revents_ & EPOLLHUP) && !(revents_ & EPOLLIN)) // When TcpConnection's Channel is closed by shutdown write end, epoll triggers EPOLLHUP
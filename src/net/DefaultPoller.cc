@@ -2,6 +2,8 @@
 
 #include "Poller.h"
 #include "EPollPoller.h"
+#include "IoUringPoller.h"
+#include "Logger.h"
 
 Poller *Poller::newDefaultPoller(EventLoop *loop)
 {
@@ -9,8 +11,19 @@ Poller *Poller::newDefaultPoller(EventLoop *loop)
     {
         return nullptr; // 生成poll的实例
     }
+    else if (::getenv("MUDUO_USE_IOURING"))
+    {
+        IoUringPoller *poller = new IoUringPoller(loop); // 生成io_uring的实例
+        if (poller->valid())
+        {
+            return poller;
+        }
+        LOG_ERROR << "io_uring unavailable, fall back to epoll";
+        delete poller;
+        return new EPollPoller(loop);
+    }
     else
     {
         return new EPollPoller(loop); // 生成epoll的实例
     }
-}
\ No newline at end of file
+}
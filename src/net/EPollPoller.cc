@@ -62,7 +62,7 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 void EPollPoller::updateChannel(Channel *channel)
 {
     const int index = channel->index();
-    LOG_INFO << "func =>" << "fd" << channel->fd() << "events=" << channel->events() << "index=" << index;
+    LOG_DEBUG << "func =>" << "fd" << channel->fd() << "events=" << channel->events() << "index=" << index;
 
     if (index == kNew || index == kDeleted)
     {
@@ -95,7 +95,7 @@ void EPollPoller::removeChannel(Channel *channel)
     int fd = channel->fd();
     channels_.erase(fd);
 
-    LOG_INFO << "removeChannel fd=" << fd;
+    LOG_DEBUG << "removeChannel fd=" << fd;
 
     int index = channel->index();
     if (index == kAdded)
@@ -9,7 +9,9 @@
 #include "Channel.h"
 #include "EventLoop.h"
 #include "Logger.h"
+#include "IoUringPoller.h"
 #include "Poller.h"
+#include "ZeroCopyLinger.h"
 
 // In case of one thread create multiple EventLoop
 thread_local EventLoop *t_loopInThisThread = nullptr;
@@ -35,7 +37,7 @@ int createEventfd()
 }
 
 EventLoop::EventLoop()
-    : looping_(false), quit_(false), callingPendingFunctors_(false), threadId_(CurrentThread::tid()), poller_(Poller::newDefaultPoller(this)), wakeupFd_(createEventfd()), wakeupChannel_(new Channel(this, wakeupFd_))
+    : looping_(false), quit_(false), exited_(false), callingPendingFunctors_(false), threadId_(CurrentThread::tid()), busyPollMicroSeconds_(0), spinning_(false), spinPolls_(0), spinHits_(0), blockingPolls_(0), fallbacks_(0), poller_(Poller::newDefaultPoller(this)), ioUringPoller_(dynamic_cast<IoUringPoller *>(poller_.get())), timerQueue_(new TimerQueue(this)), wakeupFd_(createEventfd()), wakeupChannel_(new Channel(this, wakeupFd_)), wakeupPending_(false), splicePipe_{-1, -1}
 {
     LOG_DEBUG << "EventLoop created" << this << "in thread" << threadId_;
     if (t_loopInThisThread)
@@ -55,13 +57,32 @@ EventLoop::~EventLoop()
     wakeupChannel_->disableAll(); // Remove all event from channel
     wakeupChannel_->remove();     // Delete Channel from channel
     ::close(wakeupFd_);
+    if (splicePipe_[0] >= 0)
+    {
+        ::close(splicePipe_[0]);
+        ::close(splicePipe_[1]);
+    }
     t_loopInThisThread = nullptr;
 }
 
+bool EventLoop::splicePipe(int *readFd, int *writeFd)
+{
+    if (splicePipe_[0] < 0 && ::pipe2(splicePipe_, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        LOG_ERROR << "EventLoop::splicePipe pipe2 error: " << errno;
+        splicePipe_[0] = splicePipe_[1] = -1;
+        return false;
+    }
+    *readFd = splicePipe_[0];
+    *writeFd = splicePipe_[1];
+    return true;
+}
+
 void EventLoop::loop()
 {
     looping_ = true;
     quit_ = false;
+    exited_ = false;
 
     LOG_INFO << "EventLoop start looping";
 
@@ -69,8 +90,29 @@ void EventLoop::loop()
     {
         activeChannels_.clear(); ///< Clear last time active channels
 
-        /// Get active channels(event happened) from Poller
-        pollRetureTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        /// Get active channels(event happened) from Poller,
+        /// in busy poll mode do not block while the last event is less than busyPollMicroSeconds_ ago
+        int timeoutMs = kPollTimeMs;
+        if (busyPollMicroSeconds_ > 0)
+        {
+            bool spin = pollRetureTime_.microSecondsSinceEpoch() - lastActiveTime_.microSecondsSinceEpoch() < busyPollMicroSeconds_;
+            if (spinning_ && !spin)
+            {
+                fallbacks_.fetch_add(1, std::memory_order_relaxed);
+            }
+            spinning_ = spin;
+            timeoutMs = spin ? 0 : kPollTimeMs;
+            (spin ? spinPolls_ : blockingPolls_).fetch_add(1, std::memory_order_relaxed);
+        }
+        pollRetureTime_ = poller_->poll(timeoutMs, &activeChannels_);
+        if (busyPollMicroSeconds_ > 0 && !activeChannels_.empty())
+        {
+            lastActiveTime_ = pollRetureTime_;
+            if (spinning_)
+            {
+                spinHits_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
 
         for (Channel *channel : activeChannels_)
         {
@@ -86,6 +128,28 @@ void EventLoop::loop()
     }
     LOG_INFO << "EventLoopstop looping";
     looping_ = false;
+    /// Functors queued after the last iteration's drain still run, later ones are reported by hasExited()
+    doPendingFunctors();
+    exited_ = true;
+}
+
+ZeroCopyLinger *EventLoop::zeroCopyLinger()
+{
+    if (!zeroCopyLinger_)
+    {
+        zeroCopyLinger_.reset(new ZeroCopyLinger(this));
+    }
+    return zeroCopyLinger_.get();
+}
+
+EventLoop::BusyPollStats EventLoop::busyPollStats() const
+{
+    BusyPollStats stats;
+    stats.spinPolls = spinPolls_.load(std::memory_order_relaxed);
+    stats.spinHits = spinHits_.load(std::memory_order_relaxed);
+    stats.blockingPolls = blockingPolls_.load(std::memory_order_relaxed);
+    stats.fallbacks = fallbacks_.load(std::memory_order_relaxed);
+    return stats;
 }
 
 void EventLoop::quit()
@@ -107,16 +171,33 @@ void EventLoop::runInLoop(Functor cb)
     }
     else ///< Not in current loop, wake up EventLoop thread to execute callback
     {
-        queueInLoop(cb);
+        queueInLoop(std::move(cb));
     }
 }
 
-void EventLoop::queueInLoop(Functor cb)
+void EventLoop::runInLoopBatch(std::vector<Functor> &&cbs)
 {
+    if (isInLoopThread())
     {
-        std::unique_lock<std::mutex> lock(mutex_);
-        pendingFunctors_.emplace_back(cb);
+        for (Functor &cb : cbs)
+        {
+            cb();
+        }
+    }
+    else
+    {
+        for (Functor &cb : cbs)
+        {
+            pendingFunctors_.push(std::move(cb));
+        }
+        wakeup(); ///< One wakeup for the whole batch
     }
+    cbs.clear();
+}
+
+void EventLoop::queueInLoop(Functor cb)
+{
+    pendingFunctors_.push(std::move(cb));
 
     /// if the current loop is not in the thread of itself or if it is executing callback functions,
     if (!isInLoopThread() || callingPendingFunctors_)
@@ -133,10 +214,17 @@ void EventLoop::handleWakeupRead()
     {
         LOG_ERROR << "EventLoop::handleRead() reads" << n << "bytes instead of 8";
     }
+    /// Wakeup consumed, functors queued before this point are run by doPendingFunctors() of this iteration,
+    /// the next submitter has to write again. exchange() pairs with the one in wakeup() to see their functors.
+    wakeupPending_.exchange(false, std::memory_order_acq_rel);
 }
 
 void EventLoop::wakeup()
 {
+    if (wakeupPending_.exchange(true, std::memory_order_acq_rel))
+    {
+        return; ///< Loop has not read the last wakeup yet, it will run our functors too
+    }
     uint64_t one = 1;
     ssize_t n = write(wakeupFd_, &one, sizeof(one));
     if (n != sizeof(one))
@@ -166,11 +254,8 @@ void EventLoop::doPendingFunctors()
     std::vector<Functor> functors;
     callingPendingFunctors_ = true;
 
-    {
-        /// Lock: in case of other threads calling queueInLoop() to add callback function to pendingFunctors_
-        std::unique_lock<std::mutex> lock(mutex_);
-        functors.swap(pendingFunctors_); /// Put the pending functors to the local vector
-    }
+    /// Take the functors queued so far, functors queued by them run in the next iteration
+    pendingFunctors_.popAll(functors);
 
     for (const Functor &functor : functors)
     {
@@ -9,10 +9,20 @@ EventLoopThread::EventLoopThread(const ThreadInitCallback &cb,
 
 EventLoopThread::~EventLoopThread()
 {
-    exiting_ = true;
-    if (loop_ != nullptr)
+    bool started = false;
+    {
+        /// Quit under the lock, the thread destroys the loop once it sees exiting_
+        std::unique_lock<std::mutex> lock(mutex_);
+        exiting_ = true;
+        if (loop_ != nullptr)
+        {
+            started = true;
+            loop_->quit();
+        }
+        cond_.notify_one();
+    }
+    if (started)
     {
-        loop_->quit();
         thread_.join();
     }
 }
@@ -48,6 +58,11 @@ void EventLoopThread::threadFunc()
         cond_.notify_one();
     }
     loop.loop(); ///< Execute EventLoop::loop(), set up bottom level Poller poll()
+
+    /// Keep the loop alive after quit() until this object is destroyed,
+    /// owners of channels on it (e.g. TcpServer) can still tear them down
     std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this]()
+               { return exiting_; });
     loop_ = nullptr;
 }
\ No newline at end of file
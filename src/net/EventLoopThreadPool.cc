@@ -3,9 +3,10 @@
 #include <EventLoopThreadPool.h>
 #include <EventLoopThread.h>
 #include <Logger.h>
+#include <Numa.h>
 
 EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg)
-    : baseLoop_(baseLoop), name_(nameArg), started_(false), numThreads_(0), next_(0), hash_(3)
+    : baseLoop_(baseLoop), name_(nameArg), started_(false), numThreads_(0), next_(0), numaPlacement_(false), selection_(kRoundRobin), capacityFactor_(1.25), hash_(ConsistentHash::kMaglev, 4099), random_(2463534242u)
 {
 }
 
@@ -23,9 +24,22 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb)
         char buf[name_.size() + 32];
         snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i);
         EventLoopThread *t = new EventLoopThread(cb, buf);
+        if (!threadCpus_.empty())
+        {
+            t->setCpuAffinity(threadCpus_[i % threadCpus_.size()]);
+        }
+        else if (numaPlacement_)
+        {
+            t->setCpuAffinity(RainMemoPool::Numa::nodeCpus(i % RainMemoPool::Numa::nodeCount()));
+        }
         threads_.push_back(std::unique_ptr<EventLoopThread>(t));
         loops_.push_back(t->startLoop()); // Bottom level create thread and bind a new EventLoop and return the address of the loop
-        hash_.addNode(buf);               // Add thread to consistent hash
+        hash_.addNode(buf);               // Node index is i, the same as loops_
+    }
+    loads_.reset(new std::atomic<int>[loops_.size()]);
+    for (size_t i = 0; i < loops_.size(); ++i)
+    {
+        loads_[i] = 0;
     }
 
     if (numThreads_ == 0 && cb) // The whole server only has one thread run baseLoop
@@ -34,16 +48,79 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb)
     }
 }
 
-EventLoop *EventLoopThreadPool::getNextLoop(const std::string &key)
+EventLoop *EventLoopThreadPool::getNextLoop(const InetAddress &peerAddr)
+{
+    if (loops_.empty())
+    {
+        return baseLoop_;
+    }
+
+    const size_t n = loops_.size();
+    size_t index = 0;
+    switch (selection_)
+    {
+    case kRoundRobin:
+        index = next_;
+        next_ = (next_ + 1) % n;
+        break;
+    case kLeastConnections:
+        // Scan from the round robin cursor, ties do not all go to loop 0
+        index = next_;
+        for (size_t i = 1; i < n; ++i)
+        {
+            size_t j = (next_ + i) % n;
+            if (loads_[j].load(std::memory_order_relaxed) < loads_[index].load(std::memory_order_relaxed))
+            {
+                index = j;
+            }
+        }
+        next_ = (next_ + 1) % n;
+        break;
+    case kPowerOfTwoChoices:
+    {
+        // xorshift32, only called in the base loop thread
+        random_ ^= random_ << 13;
+        random_ ^= random_ >> 17;
+        random_ ^= random_ << 5;
+        size_t a = random_ % n;
+        size_t b = (a + 1 + (random_ >> 16) % (n > 1 ? n - 1 : 1)) % n; // b != a if n > 1
+        index = loads_[b].load(std::memory_order_relaxed) < loads_[a].load(std::memory_order_relaxed) ? b : a;
+        break;
+    }
+    case kIpAffinity:
+        index = static_cast<size_t>(hash_.getNode(peerAddr.toIp()));
+        break;
+    case kBoundedIpAffinity:
+        index = static_cast<size_t>(hash_.getNode(peerAddr.toIp(), loads_, capacityFactor_));
+        break;
+    case kCustom:
+        index = selector_ ? selector_(peerAddr.toIp(), loads()) % n : 0;
+        break;
+    }
+    loads_[index].fetch_add(1, std::memory_order_relaxed);
+    return loops_[index];
+}
+
+void EventLoopThreadPool::releaseLoop(EventLoop *loop)
+{
+    for (size_t i = 0; i < loops_.size(); ++i)
+    {
+        if (loops_[i] == loop)
+        {
+            loads_[i].fetch_sub(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+std::vector<int> EventLoopThreadPool::loads() const
 {
-    size_t index = hash_.getNode(key);
-    if (index >= loops_.size())
+    std::vector<int> result(loops_.size());
+    for (size_t i = 0; i < loops_.size(); ++i)
     {
-        /// Handle error, such as returning baseLoop or throwing exceptions
-        LOG_ERROR << "EventLoopThreadPool::getNextLoop ERROR";
-        return baseLoop_; ///< Or return nullptr
+        result[i] = loads_[i].load(std::memory_order_relaxed);
     }
-    return loops_[index]; ///< Use index to access loops_
+    return result;
 }
 
 std::vector<EventLoop *> EventLoopThreadPool::getAllLoops()
@@ -0,0 +1,207 @@
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "IoUring.h"
+#include "Logger.h"
+
+static int ioUringSetup(unsigned entries, io_uring_params *params)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+IoUring::IoUring(unsigned entries)
+    : ringFd_(-1), features_(0), sqRingPtr_(MAP_FAILED), sqRingSize_(0), sqHead_(nullptr), sqTail_(nullptr), sqMask_(0), sqEntries_(0), sqes_(nullptr), sqesSize_(0), sqeTail_(0), submitted_(0), cqRingPtr_(MAP_FAILED), cqRingSize_(0), cqHead_(nullptr), cqTail_(nullptr), cqMask_(0), cqes_(nullptr)
+{
+    io_uring_params params;
+    ::memset(&params, 0, sizeof(params));
+    int fd = ioUringSetup(entries, &params);
+    if (fd < 0)
+    {
+        LOG_ERROR << "io_uring_setup error:" << errno;
+        return;
+    }
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP) ||
+        !(params.features & IORING_FEAT_CQE_SKIP))
+    {
+        /// Need EXT_ARG for timeout wait, NODROP to never lose a completion (Linux 5.11+),
+        /// and CQE_SKIP for the IOSQE_CQE_SKIP_SUCCESS removals and cancels (Linux 5.17+)
+        LOG_ERROR << "io_uring features not supported:" << params.features;
+        ::close(fd);
+        return;
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+
+    sqRingPtr_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqRingPtr_ == MAP_FAILED)
+    {
+        LOG_ERROR << "io_uring mmap sq ring error:" << errno;
+        ::close(fd);
+        return;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        cqRingPtr_ = sqRingPtr_;
+    }
+    else
+    {
+        cqRingPtr_ = ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqRingPtr_ == MAP_FAILED)
+        {
+            LOG_ERROR << "io_uring mmap cq ring error:" << errno;
+            ::munmap(sqRingPtr_, sqRingSize_);
+            sqRingPtr_ = MAP_FAILED;
+            ::close(fd);
+            return;
+        }
+    }
+
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        LOG_ERROR << "io_uring mmap sqes error:" << errno;
+        if (cqRingPtr_ != sqRingPtr_)
+        {
+            ::munmap(cqRingPtr_, cqRingSize_);
+        }
+        ::munmap(sqRingPtr_, sqRingSize_);
+        sqRingPtr_ = cqRingPtr_ = MAP_FAILED;
+        ::close(fd);
+        return;
+    }
+    sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+    char *sq = static_cast<char *>(sqRingPtr_);
+    sqHead_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqEntries_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_entries);
+    /// SQ array maps ring slot to sqe index one by one, so we can fill sqes_ in ring order
+    unsigned *array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < sqEntries_; ++i)
+    {
+        array[i] = i;
+    }
+    sqeTail_ = submitted_ = *sqTail_;
+
+    char *cq = static_cast<char *>(cqRingPtr_);
+    cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    features_ = params.features;
+    ringFd_ = fd;
+}
+
+IoUring::~IoUring()
+{
+    if (sqes_)
+    {
+        ::munmap(sqes_, sqesSize_);
+    }
+    if (cqRingPtr_ != MAP_FAILED && cqRingPtr_ != sqRingPtr_)
+    {
+        ::munmap(cqRingPtr_, cqRingSize_);
+    }
+    if (sqRingPtr_ != MAP_FAILED)
+    {
+        ::munmap(sqRingPtr_, sqRingSize_);
+    }
+    if (ringFd_ >= 0)
+    {
+        ::close(ringFd_);
+    }
+}
+
+io_uring_sqe *IoUring::getSqe()
+{
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqeTail_ - head >= sqEntries_)
+    {
+        /// SQ is full, flush queued entries to the kernel to get free slots
+        submit();
+        head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        if (sqeTail_ - head >= sqEntries_)
+        {
+            return nullptr;
+        }
+    }
+    io_uring_sqe *sqe = &sqes_[sqeTail_ & sqMask_];
+    ::memset(sqe, 0, sizeof(*sqe));
+    ++sqeTail_;
+    return sqe;
+}
+
+int IoUring::enter(unsigned toSubmit, unsigned minComplete, unsigned flags, const void *arg, size_t argSize)
+{
+    int ret = static_cast<int>(::syscall(__NR_io_uring_enter, ringFd_, toSubmit, minComplete, flags, arg, argSize));
+    return ret < 0 ? -errno : ret;
+}
+
+int IoUring::submit()
+{
+    return submitAndWait(0, 0);
+}
+
+int IoUring::submitAndWait(unsigned waitNr, int timeoutMs)
+{
+    unsigned toSubmit = sqeTail_ - submitted_;
+    if (toSubmit > 0)
+    {
+        /// Publish the new tail, kernel can see all sqes filled before
+        __atomic_store_n(sqTail_, sqeTail_, __ATOMIC_RELEASE);
+        submitted_ = sqeTail_;
+    }
+    if (toSubmit == 0 && waitNr == 0)
+    {
+        return 0;
+    }
+
+    unsigned flags = waitNr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    if (waitNr > 0 && timeoutMs >= 0)
+    {
+        __kernel_timespec ts;
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000 * 1000;
+
+        io_uring_getevents_arg arg;
+        ::memset(&arg, 0, sizeof(arg));
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+        return enter(toSubmit, waitNr, flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    }
+    return enter(toSubmit, waitNr, flags, nullptr, 0);
+}
+
+io_uring_cqe *IoUring::peekCqe()
+{
+    unsigned head = *cqHead_;
+    if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE))
+    {
+        return nullptr;
+    }
+    return &cqes_[head & cqMask_];
+}
+
+void IoUring::cqeSeen()
+{
+    __atomic_store_n(cqHead_, *cqHead_ + 1, __ATOMIC_RELEASE);
+}
+
+int IoUring::registerOp(unsigned opcode, const void *arg, unsigned nrArgs)
+{
+    int ret = static_cast<int>(::syscall(__NR_io_uring_register, ringFd_, opcode, arg, nrArgs));
+    return ret < 0 ? -errno : ret;
+}
@@ -0,0 +1,347 @@
+#include <sys/epoll.h>
+#include <sys/mman.h>
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "Channel.h"
+#include "IoUringPoller.h"
+#include "Logger.h"
+
+const int kNew = -1;    // Have not registered to Poller, channel menber index_ initialize to -1
+const int kAdded = 1;   // Have registered to Poller
+const int kDeleted = 2; // Have deleted from Poller
+
+IoUringPoller::IoUringPoller(EventLoop *loop)
+    : Poller(loop), ring_(kRingEntries), nextGen_(1), round_(0), nextOpToken_(1), bufferBase_(nullptr), bufferRing_(nullptr), bufferTail_(nullptr), localTail_(0)
+{
+}
+
+IoUringPoller::~IoUringPoller()
+{
+    if (bufferRing_)
+    {
+        io_uring_buf_reg reg;
+        ::memset(&reg, 0, sizeof(reg));
+        reg.bgid = kBufferGroup;
+        ring_.registerOp(IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        ::munmap(bufferRing_, kProvidedBufferCount * sizeof(io_uring_buf));
+    }
+    if (bufferBase_)
+    {
+        ::munmap(bufferBase_, kProvidedBufferCount * kProvidedBufferSize);
+    }
+}
+
+Timestamp IoUringPoller::poll(int timeoutMs, ChannelList *activeChannels)
+{
+    ++round_;
+
+    for (int fd : rearmList_)
+    {
+        auto it = requests_.find(fd);
+        auto ch = channels_.find(fd);
+        if (it != requests_.end() && ch != channels_.end() && !it->second.armed && !ch->second->isNoneEvent())
+        {
+            arm(ch->second, it->second);
+        }
+    }
+    rearmList_.clear();
+
+    /// Completions may be already posted while we were handling events, no need to wait in kernel
+    int completed = fillActiveChannels(activeChannels);
+    if (activeChannels->empty() && completed == 0 && timeoutMs == 0)
+    {
+        /// Busy poll: completions are read from the shared ring, only enter the kernel to submit
+        if (ring_.pendingSubmissions() > 0)
+        {
+            ring_.submit();
+        }
+        fillActiveChannels(activeChannels);
+    }
+    else if (activeChannels->empty() && completed == 0)
+    {
+        int ret = ring_.submitAndWait(1, timeoutMs);
+        if (ret < 0 && ret != -ETIME && ret != -EINTR && ret != -EBUSY)
+        {
+            errno = -ret;
+            LOG_ERROR << "IoUringPoller::poll() error!";
+        }
+        fillActiveChannels(activeChannels);
+    }
+    else if (ring_.pendingSubmissions() > 0)
+    {
+        ring_.submit(); ///< Flush re-arms and sends queued in last iteration, don't starve them
+    }
+    return Timestamp::now();
+}
+
+void IoUringPoller::updateChannel(Channel *channel)
+{
+    const int index = channel->index();
+    const int fd = channel->fd();
+
+    if (index == kNew || index == kDeleted)
+    {
+        if (index == kNew)
+        {
+            channels_[fd] = channel;
+        }
+        /// else index == kDeleted
+        channel->set_index(kAdded);
+        PollRequest &request = requests_[fd];
+        if (request.armed)
+        {
+            disarm(fd, request);
+        }
+        if (!channel->isNoneEvent())
+        {
+            arm(channel, request);
+        }
+    }
+    else ///< Channel already registered in Poller
+    {
+        PollRequest &request = requests_[fd];
+        if (channel->isNoneEvent())
+        {
+            if (request.armed)
+            {
+                disarm(fd, request);
+            }
+            channel->set_index(kDeleted);
+        }
+        else if (!request.armed || request.events != channel->events())
+        {
+            if (request.armed)
+            {
+                disarm(fd, request);
+            }
+            arm(channel, request);
+        }
+    }
+}
+
+void IoUringPoller::removeChannel(Channel *channel)
+{
+    int fd = channel->fd();
+    channels_.erase(fd);
+
+    auto it = requests_.find(fd);
+    if (it != requests_.end())
+    {
+        if (it->second.armed)
+        {
+            disarm(fd, it->second);
+        }
+        requests_.erase(it);
+    }
+    channel->set_index(kNew);
+}
+
+int IoUringPoller::fillActiveChannels(ChannelList *activeChannels)
+{
+    int completed = 0;
+    while (io_uring_cqe *cqe = ring_.peekCqe())
+    {
+        uint64_t userData = cqe->user_data;
+        int res = cqe->res;
+        unsigned flags = cqe->flags;
+        ring_.cqeSeen();
+
+        if (userData == 0) ///< POLL_REMOVE/ASYNC_CANCEL failed, target request has completed already
+        {
+            continue;
+        }
+        if (userData & kOpFlag)
+        {
+            auto op = ops_.find(userData);
+            if (op == ops_.end())
+            {
+                continue;
+            }
+            ++completed;
+            if (flags & IORING_CQE_F_MORE)
+            {
+                op->second(res, flags); ///< Multishot op, keep the callback for next CQE
+            }
+            else
+            {
+                CompletionCallback cb = std::move(op->second);
+                ops_.erase(op);
+                cb(res, flags);
+            }
+            continue;
+        }
+
+        int fd = static_cast<int>(userData >> 32);
+        uint32_t gen = static_cast<uint32_t>(userData);
+        auto it = requests_.find(fd);
+        if (it == requests_.end() || it->second.gen != gen || !it->second.armed)
+        {
+            continue; ///< Stale completion of a removed or superseded request
+        }
+
+        PollRequest &request = it->second;
+        if (!(flags & IORING_CQE_F_MORE))
+        {
+            /// One-shot request finished, or multishot request terminated by kernel
+            request.armed = false;
+            rearmList_.push_back(fd);
+        }
+        if (res < 0)
+        {
+            if (res != -ECANCELED)
+            {
+                LOG_ERROR << "io_uring poll fd=" << fd << " error:" << -res;
+            }
+            continue;
+        }
+
+        Channel *channel = channels_[fd];
+        if (request.round != round_)
+        {
+            request.round = round_;
+            request.revents = 0;
+            activeChannels->push_back(channel); ///< EventLoop get all active channels from Poller
+        }
+        request.revents |= res;
+        channel->set_revents(request.revents);
+    }
+    return completed;
+}
+
+io_uring_sqe *IoUringPoller::getSqe()
+{
+    io_uring_sqe *sqe = ring_.getSqe();
+    if (sqe == nullptr)
+    {
+        LOG_FATAL << "io_uring sq ring full";
+    }
+    return sqe;
+}
+
+void IoUringPoller::arm(Channel *channel, PollRequest &request)
+{
+    io_uring_sqe *sqe = getSqe();
+    const int events = channel->events();
+    request.gen = nextGen_++;
+    if (nextGen_ == 0)
+    {
+        nextGen_ = 1;
+    }
+    request.events = events;
+    request.armed = true;
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = channel->fd();
+    sqe->poll32_events = static_cast<uint32_t>(events & ~EPOLLET);
+    sqe->len = (events & EPOLLET) ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data = encode(channel->fd(), request.gen);
+}
+
+void IoUringPoller::disarm(int fd, PollRequest &request)
+{
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = encode(fd, request.gen);
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS; ///< Only failed removal posts a completion, with user_data 0
+    sqe->user_data = 0;
+    request.armed = false;
+}
+
+io_uring_sqe *IoUringPoller::prepareOp(CompletionCallback cb, uint64_t *token)
+{
+    io_uring_sqe *sqe = getSqe();
+    uint64_t userData = kOpFlag | nextOpToken_++;
+    sqe->user_data = userData;
+    ops_[userData] = std::move(cb);
+    if (token)
+    {
+        *token = userData;
+    }
+    return sqe;
+}
+
+void IoUringPoller::cancelOp(uint64_t token)
+{
+    if (ops_.find(token) == ops_.end())
+    {
+        return;
+    }
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = token;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = 0;
+}
+
+bool IoUringPoller::ensureProvidedBuffers()
+{
+    if (bufferBase_)
+    {
+        return true;
+    }
+
+    /// Ring memory must be page aligned, 128 entries * 16B fit in one page
+    void *ring = ::mmap(nullptr, kProvidedBufferCount * sizeof(io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (ring == MAP_FAILED)
+    {
+        LOG_ERROR << "IoUringPoller::ensureProvidedBuffers mmap ring error:" << errno;
+        return false;
+    }
+    io_uring_buf_reg reg;
+    ::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = kProvidedBufferCount;
+    reg.bgid = kBufferGroup;
+    int ret = ring_.registerOp(IORING_REGISTER_PBUF_RING, &reg, 1);
+    if (ret < 0)
+    {
+        errno = -ret;
+        LOG_ERROR << "IoUringPoller::ensureProvidedBuffers register buffer ring error:" << -ret;
+        ::munmap(ring, kProvidedBufferCount * sizeof(io_uring_buf));
+        return false;
+    }
+
+    /// Pages are only touched when kernel fills them
+    void *base = ::mmap(nullptr, kProvidedBufferCount * kProvidedBufferSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        LOG_ERROR << "IoUringPoller::ensureProvidedBuffers mmap error:" << errno;
+        ring_.registerOp(IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        ::munmap(ring, kProvidedBufferCount * sizeof(io_uring_buf));
+        return false;
+    }
+    bufferBase_ = static_cast<char *>(base);
+
+    /// Index entries from the ring start, not through io_uring_buf_ring::bufs: compiled as C++ the
+    /// header's flexible array member sits behind an empty struct, 8 bytes after where the kernel reads.
+    /// The tail is overlaid on the resv field of the first entry.
+    bufferRing_ = static_cast<io_uring_buf *>(ring);
+    bufferTail_ = reinterpret_cast<uint16_t *>(static_cast<char *>(ring) + offsetof(io_uring_buf, resv));
+    for (unsigned bid = 0; bid < kProvidedBufferCount; ++bid)
+    {
+        addBuffer(static_cast<uint16_t>(bid));
+    }
+    __atomic_store_n(bufferTail_, localTail_, __ATOMIC_RELEASE);
+    return true;
+}
+
+void IoUringPoller::addBuffer(uint16_t bid)
+{
+    io_uring_buf *buf = &bufferRing_[localTail_ & (kProvidedBufferCount - 1)];
+    buf->addr = reinterpret_cast<uint64_t>(providedBuffer(bid));
+    buf->len = kProvidedBufferSize;
+    buf->bid = bid;
+    ++localTail_;
+}
+
+void IoUringPoller::recycleBuffer(uint16_t bid)
+{
+    addBuffer(bid);
+    /// Release store: the kernel reads the entry only after it sees the new tail
+    __atomic_store_n(bufferTail_, localTail_, __ATOMIC_RELEASE);
+}
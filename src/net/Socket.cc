@@ -3,6 +3,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 
+#include <errno.h>
 #include <netinet/tcp.h>
 #include <string.h>
 
@@ -23,9 +24,9 @@ void Socket::bindAddress(const InetAddress &localaddr)
     }
 }
 
-void Socket::listen()
+void Socket::listen(int backlog)
 {
-    if (0 != ::listen(sockfd_, 1024))
+    if (0 != ::listen(sockfd_, backlog))
     {
         LOG_FATAL << "bind sockfd:" << sockfd_ << "fail";
     }
@@ -75,4 +76,35 @@ void Socket::setKeepAlive(bool on)
 {
     int optval = on ? 1 : 0;
     ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof(optval));
-}
\ No newline at end of file
+}
+
+void Socket::setDeferAccept(int seconds)
+{
+    if (::setsockopt(sockfd_, IPPROTO_TCP, TCP_DEFER_ACCEPT, &seconds, sizeof(seconds)) < 0)
+    {
+        LOG_ERROR << "setDeferAccept error: " << errno;
+    }
+}
+
+void Socket::setFastOpen(int qlen)
+{
+    if (::setsockopt(sockfd_, IPPROTO_TCP, TCP_FASTOPEN, &qlen, sizeof(qlen)) < 0)
+    {
+        LOG_ERROR << "setFastOpen error: " << errno;
+    }
+}
+
+void Socket::setBusyPoll(int usec)
+{
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69 // Linux 5.11
+#endif
+    // Raising SO_BUSY_POLL above net.core.busy_read needs CAP_NET_ADMIN
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0)
+    {
+        LOG_ERROR << "setBusyPoll SO_BUSY_POLL error: " << errno;
+        return;
+    }
+    int prefer = usec > 0 ? 1 : 0;
+    ::setsockopt(sockfd_, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer)); // Not supported by old kernels
+}
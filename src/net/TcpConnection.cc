@@ -1,5 +1,7 @@
+#include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <sys/sendfile.h>
+#include <sys/stat.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
@@ -8,14 +10,17 @@
 #include <string.h>
 #include <unistd.h> // for close
 
+#include <algorithm>
 #include <functional>
 #include <string>
 
 #include "Channel.h"
 #include "EventLoop.h"
+#include "IoUringPoller.h"
 #include "Logger.h"
 #include "Socket.h"
 #include "TcpConnection.h"
+#include "ZeroCopyLinger.h"
 
 static EventLoop *CheckLoopNotNull(EventLoop *loop)
 {
@@ -26,29 +31,58 @@ static EventLoop *CheckLoopNotNull(EventLoop *loop)
     return loop;
 }
 
+TcpConnection::TcpConnection(EventLoop *loop,
+                             uint64_t id,
+                             const std::shared_ptr<const std::string> &namePrefix,
+                             int sockfd,
+                             const InetAddress &localAddr,
+                             const InetAddress &peerAddr)
+    : loop_(CheckLoopNotNull(loop)), id_(id), namePrefix_(namePrefix), state_(kConnecting), reading_(true), socket_(sockfd), channel_(loop, sockfd), localAddr_(localAddr), peerAddr_(peerAddr), highWaterMark_(64 * 1024 * 1024) /* 64M */, eventByteBudget_(1024 * 1024) /* 1M */, readIdleTimeout_(0), writeIdleTimeout_(0), lifetime_(0), timeoutArmed_(false), zeroCopyThreshold_(0), zeroCopyEnabled_(false), zeroCopySeq_(0), completionIo_(false), recvToken_(0), sendToken_(0), sendInFlight_(false)
+{
+    // Lambdas capturing only this fit in std::function's local storage, std::bind of a member function does not
+    channel_.setReadCallback(
+        [this](Timestamp receiveTime)
+        { handleRead(receiveTime); });
+    channel_.setWriteCallback(
+        [this]()
+        { handleWrite(); });
+    channel_.setCloseCallback(
+        [this]()
+        { handleClose(); });
+    channel_.setErrorCallback(
+        [this]()
+        { handleError(); });
+
+    LOG_DEBUG << "TcpConnection::ctor:[" << name().c_str() << "]at fd=" << sockfd;
+    socket_.setKeepAlive(true);
+}
+
 TcpConnection::TcpConnection(EventLoop *loop,
                              const std::string &nameArg,
                              int sockfd,
                              const InetAddress &localAddr,
                              const InetAddress &peerAddr)
-    : loop_(CheckLoopNotNull(loop)), name_(nameArg), state_(kConnecting), reading_(true), socket_(new Socket(sockfd)), channel_(new Channel(loop, sockfd)), localAddr_(localAddr), peerAddr_(peerAddr), highWaterMark_(64 * 1024 * 1024) // 64M
+    : TcpConnection(loop, 0, std::shared_ptr<const std::string>(std::make_shared<std::string>(nameArg)), sockfd, localAddr, peerAddr)
 {
-    channel_->setReadCallback(
-        std::bind(&TcpConnection::handleRead, this, std::placeholders::_1));
-    channel_->setWriteCallback(
-        std::bind(&TcpConnection::handleWrite, this));
-    channel_->setCloseCallback(
-        std::bind(&TcpConnection::handleClose, this));
-    channel_->setErrorCallback(
-        std::bind(&TcpConnection::handleError, this));
+}
 
-    LOG_INFO << "TcpConnection::ctor:[" << name_.c_str() << "]at fd=" << sockfd;
-    socket_->setKeepAlive(true);
+const std::string &TcpConnection::name() const
+{
+    // Built on first use, a connection that is never logged never formats its name
+    std::call_once(nameOnce_, [this]()
+                   { name_ = id_ == 0 ? *namePrefix_ : *namePrefix_ + std::to_string(id_ >> 32); });
+    return name_;
 }
 
 TcpConnection::~TcpConnection()
 {
-    LOG_INFO << "TcpConnection::dtor[" << name_.c_str() << "]at fd=" << channel_->fd() << "state=" << (int)state_;
+    LOG_DEBUG << "TcpConnection::dtor[" << name().c_str() << "]at fd=" << channel_.fd() << "state=" << (int)state_;
+}
+
+void TcpConnection::setEdgeTriggered(bool on, size_t eventByteBudget)
+{
+    eventByteBudget_ = eventByteBudget;
+    channel_.setEdgeTriggered(on);
 }
 
 void TcpConnection::send(const std::string &buf)
@@ -58,33 +92,129 @@ void TcpConnection::send(const std::string &buf)
         // Single readctor, user call conn->send(), loop_ is current thread
         if (loop_->isInLoopThread())
         {
-            sendInLoop(buf.c_str(), buf.size());
+            sendInLoop(buf.c_str(), buf.size(), nullptr);
         }
         else
         {
+            // buf may be gone before the loop runs, copy it once into a slice
             loop_->runInLoop(
-                std::bind(&TcpConnection::sendInLoop, this, buf.c_str(), buf.size()));
+                std::bind(&TcpConnection::sendSliceInLoop, shared_from_this(), SharedSlice(std::string(buf))));
         }
     }
 }
 
+void TcpConnection::send(std::string &&buf)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendInLoop(buf.data(), buf.size(), nullptr, &buf);
+        }
+        else
+        {
+            loop_->runInLoop(
+                std::bind(&TcpConnection::sendSliceInLoop, shared_from_this(), SharedSlice(std::move(buf))));
+        }
+    }
+}
+
+void TcpConnection::send(Buffer &&buf)
+{
+    std::shared_ptr<Buffer> holder = std::make_shared<Buffer>(std::move(buf));
+    const char *data = holder->peek();
+    size_t len = holder->readableBytes();
+    send(SharedSlice(std::move(holder), data, len));
+}
+
+void TcpConnection::send(SharedSlice slice)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendSliceInLoop(slice);
+        }
+        else
+        {
+            loop_->runInLoop(
+                std::bind(&TcpConnection::sendSliceInLoop, shared_from_this(), std::move(slice)));
+        }
+    }
+}
+
+void TcpConnection::sendSliceInLoop(const SharedSlice &slice)
+{
+    sendInLoop(slice.data(), slice.size(), slice.owner());
+}
+
 // Sent data: Application write fast, but kernel send data slow
 // Should write data to buffer, and set watermark callback
-void TcpConnection::sendInLoop(const void *data, size_t len)
+void TcpConnection::sendInLoop(const void *data, size_t len, const std::shared_ptr<const void> &owner, std::string *movable)
 {
     ssize_t nwrote = 0;
     size_t remaining = len;
     bool faultError = false;
 
+    // Owner of the bytes that outlive this call, a movable string is moved into one on first use
+    std::shared_ptr<const void> taken;
+    auto keepAlive = [&]() -> const std::shared_ptr<const void> &
+    {
+        if (!owner && movable != nullptr && !taken)
+        {
+            std::shared_ptr<const std::string> holder = std::make_shared<const std::string>(std::move(*movable));
+            data = holder->data(); // Short strings do not keep their address when moved
+            taken = std::move(holder);
+        }
+        return owner ? owner : taken;
+    };
+
     if (state_ == kDisconnected) // After call TcpConnection::shutdown(), can not write data
     {
         LOG_ERROR << "TCP disconnected, give up writing";
     }
 
+    // Completion IO: queue data and let a SEND submission flush it with other connections' writes
+    if (recvToken_ != 0)
+    {
+        size_t oldLen = outputBuffer_.readableBytes() + (sendingBuffer_ ? sendingBuffer_->readableBytes() : 0);
+        if (oldLen == 0)
+        {
+            lastWriteTime_ = loop_->pollReturnTime(); // Output becomes pending, start the write idle clock
+        }
+        if (oldLen + len >= highWaterMark_ && oldLen < highWaterMark_ && highWaterMarkCallback_)
+        {
+            loop_->queueInLoop(
+                std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + len));
+        }
+        const std::shared_ptr<const void> &linked = keepAlive();
+        if (linked)
+        {
+            outputBuffer_.appendExternal(static_cast<const char *>(data), len, linked);
+        }
+        else
+        {
+            outputBuffer_.append(static_cast<const char *>(data), len);
+        }
+        if (!sendInFlight_ && !channel_.isWriting()) // Writing: sendFile in progress, handleWrite sends it after the files
+        {
+            submitSend();
+        }
+        return;
+    }
+
     // Channel write first data or buffer has no data to send
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    if (!channel_.isWriting() && outputBuffer_.readableBytes() == 0)
     {
-        nwrote = ::write(channel_->fd(), data, len);
+        if ((owner || movable != nullptr) && zeroCopyThreshold_ > 0 && len >= zeroCopyThreshold_)
+        {
+            const std::shared_ptr<const void> &linked = keepAlive();
+            nwrote = sendZeroCopy(static_cast<const char *>(data), len, linked);
+        }
+        else
+        {
+            nwrote = ::write(channel_.fd(), data, len);
+        }
         if (nwrote >= 0)
         {
             remaining = len - nwrote;
@@ -116,19 +246,49 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
     {
         // Data left to be sent in output buffer
         size_t oldLen = outputBuffer_.readableBytes();
+        if (oldLen == 0)
+        {
+            lastWriteTime_ = loop_->pollReturnTime(); // Output becomes pending, start the write idle clock
+        }
         if (oldLen + remaining >= highWaterMark_ && oldLen < highWaterMark_ && highWaterMarkCallback_)
         {
             loop_->queueInLoop(
                 std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
         }
-        outputBuffer_.append((char *)data + nwrote, remaining);
-        if (!channel_->isWriting())
+        const std::shared_ptr<const void> &linked = keepAlive();
+        if (linked) // Payload is kept alive by its owner, link it instead of copying
+        {
+            outputBuffer_.appendExternal(static_cast<const char *>(data) + nwrote, remaining, linked);
+        }
+        else
+        {
+            outputBuffer_.append(static_cast<const char *>(data) + nwrote, remaining);
+        }
+        if (!channel_.isWriting())
         {
-            channel_->enableWriting(); // Must register channel write event, otherwise poller will not notify channel
+            channel_.enableWriting(); // Must register channel write event, otherwise poller will not notify channel
         }
     }
 }
 
+void TcpConnection::forceClose()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        setState(kDisconnecting);
+        loop_->queueInLoop(
+            std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        handleClose(); // Same as the peer closed the connection
+    }
+}
+
 void TcpConnection::shutdown()
 {
     if (state_ == kConnected)
@@ -142,17 +302,22 @@ void TcpConnection::shutdown()
 void TcpConnection::shutdownInLoop()
 {
     // Current outputBuffer_ all data has been sent
-    if (!channel_->isWriting())
+    if (!channel_.isWriting() && !sendInFlight_)
     {
-        socket_->shutdownWrite();
+        socket_.shutdownWrite();
     }
 }
 
 void TcpConnection::connectEstablished()
 {
     setState(kConnected);
-    channel_->tie(shared_from_this());
-    channel_->enableReading(); // Register channel EPOLLIN read event to poller
+    channel_.tie(shared_from_this());
+    if (!(completionIo_ && startRecv()))
+    {
+        channel_.enableReading(); // Register channel EPOLLIN read event to poller
+    }
+    createTime_ = lastReadTime_ = lastWriteTime_ = Timestamp::now();
+    scheduleTimeout(createTime_);
 
     // New connection, execute callback
     connectionCallback_(shared_from_this());
@@ -163,10 +328,39 @@ void TcpConnection::connectDestroyed()
     if (state_ == kConnected)
     {
         setState(kDisconnected);
-        channel_->disableAll(); // Remove all interested events from poller
+        channel_.disableAll(); // Remove all interested events from poller
+        stopCompletionIo();
+        abortFileTransfers(ECONNABORTED);
+        if (timeoutArmed_)
+        {
+            loop_->cancel(timeoutTimer_);
+            timeoutArmed_ = false;
+        }
         connectionCallback_(shared_from_this());
     }
-    channel_->remove(); // Remove channel from poller
+    channel_.remove(); // Remove channel from poller
+    lingerZeroCopy();
+}
+
+// The kernel may still send from pinned payloads after close, hand them to the loop until their completion
+void TcpConnection::lingerZeroCopy()
+{
+    if (!zeroCopyPending_.empty())
+    {
+        handleZeroCopyCompletions();
+    }
+    if (zeroCopyPending_.empty())
+    {
+        return;
+    }
+    int fd = ::dup(channel_.fd());
+    if (fd < 0)
+    {
+        LOG_ERROR << "TcpConnection::lingerZeroCopy dup error: " << errno << ", payloads stay with the connection";
+        return;
+    }
+    loop_->zeroCopyLinger()->add(fd, std::move(zeroCopyPending_));
+    zeroCopyPending_.clear();
 }
 
 // Read is relative to the server,
@@ -174,78 +368,212 @@ void TcpConnection::connectDestroyed()
 // the server detects EPOLLIN and triggers the callback on that fd handleRead to read the data sent by the peer.
 void TcpConnection::handleRead(Timestamp receiveTime)
 {
+    // Level triggered: one readv per wakeup, poller reports the fd again if data is left
+    // Edge triggered: no more wakeup for data already queued, read until EAGAIN or the budget is used up
+    const bool drain = channel_.isEdgeTriggered();
+    size_t total = 0;
     int savedErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
-    if (n > 0) // Data arrived
+    ssize_t n = 0;
+    for (;;)
+    {
+        n = inputBuffer_.readFd(channel_.fd(), &savedErrno);
+        if (n <= 0)
+        {
+            break;
+        }
+        total += n;
+        if (!drain || total >= eventByteBudget_)
+        {
+            break;
+        }
+    }
+
+    if (total > 0) // Data arrived
     {
+        lastReadTime_ = receiveTime;
         // Connected user has readable event, call user callback onMessage
         // shared_from_this() gets the smart pointer of TcpConnection
         messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
     }
-    else if (n == 0) // Client server Connection closed
+
+    if (n == 0) // Client server Connection closed
     {
         handleClose();
     }
-    else // With an error
+    else if (n < 0) // With an error
     {
-        errno = savedErrno;
-        LOG_ERROR << "TcpConnection::handleRead";
-        handleError();
+        if (!(drain && (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK))) // EAGAIN: edge triggered fd drained
+        {
+            errno = savedErrno;
+            LOG_ERROR << "TcpConnection::handleRead";
+            handleError();
+        }
+    }
+    else if (drain) // Budget used up, continue after other channels and pending functors of this loop
+    {
+        TcpConnectionPtr guard(shared_from_this());
+        loop_->queueInLoop(
+            [guard, receiveTime]()
+            {
+                if (guard->channel_.isReading())
+                {
+                    guard->handleRead(receiveTime);
+                }
+            });
     }
 }
 
 void TcpConnection::handleWrite()
 {
-    if (channel_->isWriting())
+    if (!channel_.isWriting())
     {
-        int savedErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
-        if (n > 0)
+        LOG_ERROR << "TcpConnection fd=" << channel_.fd() << "is down, no more writing";
+        return;
+    }
+
+    // Files and outputBuffer_ bytes go out in the order they were sent:
+    // a file waits for the bytes buffered before it(e.g. HTTP headers), bytes sent after it wait for the file.
+    // A short write means the socket send buffer is full, so edge triggered mode also gets a new EPOLLOUT.
+    size_t budget = eventByteBudget_;
+    int savedErrno = 0;
+    ssize_t n = 1;
+    while (!fileTransfers_.empty() && n > 0 && budget > 0)
+    {
+        FileTransfer &transfer = fileTransfers_.front();
+        if (transfer.bufferedBefore > 0)
         {
-            outputBuffer_.retrieve(n); // Read from buffer Readable area and move readindex
-            if (outputBuffer_.readableBytes() == 0)
+            n = writeOutputBuffer(std::min(transfer.bufferedBefore, budget), &savedErrno);
+            if (n > 0)
             {
-                channel_->disableWriting();
-                if (writeCompleteCallback_)
-                {
-                    // TcpConnection object in the subloop, add callback to pendingFunctors_
-                    loop_->queueInLoop(
-                        std::bind(writeCompleteCallback_, shared_from_this()));
-                }
-                if (state_ == kDisconnecting)
+                transfer.bufferedBefore -= n;
+            }
+        }
+        else
+        {
+            n = transmitFile(transfer, budget, &savedErrno);
+            if (n > 0)
+            {
+                lastWriteTime_ = loop_->pollReturnTime();
+                if (transfer.onProgress)
                 {
-                    shutdownInLoop(); // Delete TcpConnection in current loop
+                    transfer.onProgress(shared_from_this(), transfer.sent, transfer.count);
                 }
             }
+            if (n == 0 || (transfer.remaining == 0 && transfer.residue.empty())) // Done or end of file
+            {
+                finishFileTransfer(0);
+                n = 1;
+                continue;
+            }
         }
-        else
+        if (n > 0)
+        {
+            budget -= n;
+        }
+    }
+
+    // Readiness path writes the bytes queued after the files right away
+    if (fileTransfers_.empty() && recvToken_ == 0 && n > 0 && budget > 0 && outputBuffer_.readableBytes() > 0)
+    {
+        n = writeOutputBuffer(outputBuffer_.readableBytes(), &savedErrno);
+    }
+
+    if (n < 0 && savedErrno != EAGAIN && savedErrno != EWOULDBLOCK)
+    {
+        errno = savedErrno;
+        LOG_ERROR << "TcpConnection::handleWrite";
+        if (savedErrno == EPIPE || savedErrno == ECONNRESET)
+        {
+            abortFileTransfers(savedErrno);
+        }
+        return;
+    }
+
+    if (!fileTransfers_.empty() || (recvToken_ == 0 && outputBuffer_.readableBytes() > 0))
+    {
+        if (n > 0 && channel_.isEdgeTriggered()) // Budget used up, no new EPOLLOUT will come
         {
-            LOG_ERROR << "TcpConnection::handleWrite";
+            TcpConnectionPtr guard(shared_from_this());
+            loop_->queueInLoop(
+                [guard]()
+                {
+                    if (guard->channel_.isWriting())
+                    {
+                        guard->handleWrite();
+                    }
+                });
         }
+        return;
+    }
+
+    channel_.disableWriting();
+    if (outputBuffer_.readableBytes() > 0) // Completion IO hands the bytes after the files back to SENDMSG
+    {
+        submitSend();
+        return;
+    }
+    if (writeCompleteCallback_)
+    {
+        // TcpConnection object in the subloop, add callback to pendingFunctors_
+        loop_->queueInLoop(
+            std::bind(writeCompleteCallback_, shared_from_this()));
+    }
+    if (state_ == kDisconnecting)
+    {
+        shutdownInLoop(); // Delete TcpConnection in current loop
+    }
+}
+
+ssize_t TcpConnection::writeOutputBuffer(size_t maxBytes, int *savedErrno)
+{
+    ssize_t n = 0;
+    const std::shared_ptr<const void> &owner = outputBuffer_.frontOwner();
+    struct iovec front;
+    if (zeroCopyThreshold_ > 0 && owner && outputBuffer_.fillIovec(&front, 1) == 1 && front.iov_len >= zeroCopyThreshold_)
+    {
+        // Large external slice at the front, keep sending it with MSG_ZEROCOPY
+        n = sendZeroCopy(static_cast<const char *>(front.iov_base), std::min(front.iov_len, maxBytes), owner);
+        *savedErrno = errno;
     }
     else
     {
-        LOG_ERROR << "TcpConnection fd=" << channel_->fd() << "is down, no more writing";
+        n = outputBuffer_.writeFd(channel_.fd(), savedErrno, maxBytes);
+    }
+    if (n > 0)
+    {
+        outputBuffer_.retrieve(n); // Read from buffer Readable area and move readindex
+        lastWriteTime_ = loop_->pollReturnTime();
     }
+    return n;
 }
 
 void TcpConnection::handleClose()
 {
-    LOG_INFO << "TcpConnection::handleClose fd=" << channel_->fd() << "state=" << (int)state_;
+    LOG_INFO << "TcpConnection::handleClose fd=" << channel_.fd() << "state=" << (int)state_;
     setState(kDisconnected);
-    channel_->disableAll();
+    channel_.disableAll();
+    stopCompletionIo();
 
     TcpConnectionPtr connPtr(shared_from_this());
+    abortFileTransfers(ECONNABORTED);
+    if (timeoutArmed_)
+    {
+        loop_->cancel(timeoutTimer_); // Free the timer now, not at its deadline
+        timeoutArmed_ = false;
+    }
     connectionCallback_(connPtr); // Connect the callback
     closeCallback_(connPtr);      // Execute close callback, execute TcpServer::removeConnection
 }
 
 void TcpConnection::handleError()
 {
+    // MSG_ZEROCOPY completions are queued on the socket error queue and reported as EPOLLERR
+    bool zeroCopyOnly = !zeroCopyPending_.empty() && handleZeroCopyCompletions();
+
     int optval;
     socklen_t optlen = sizeof optval;
     int err = 0;
-    if (::getsockopt(channel_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    if (::getsockopt(channel_.fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
     {
         err = errno;
     }
@@ -253,10 +581,51 @@ void TcpConnection::handleError()
     {
         err = optval;
     }
-    LOG_ERROR << "TcpConnection::handleError name:" << name_.c_str() << "- SO_ERROR:%" << err;
+    if (zeroCopyOnly && err == 0)
+    {
+        return;
+    }
+    LOG_ERROR << "TcpConnection::handleError name:" << name().c_str() << "- SO_ERROR:%" << err;
+}
+
+// Send with MSG_ZEROCOPY and pin the payload by its owner until the kernel reports completion,
+// fall back to a plain write if the socket or the kernel can not do it.
+ssize_t TcpConnection::sendZeroCopy(const char *data, size_t len, const std::shared_ptr<const void> &owner)
+{
+    if (!zeroCopyEnabled_)
+    {
+        int on = 1;
+        if (::setsockopt(channel_.fd(), SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) < 0)
+        {
+            LOG_ERROR << "TcpConnection::sendZeroCopy SO_ZEROCOPY unsupported, errno:" << errno;
+            zeroCopyThreshold_ = 0;
+            return ::write(channel_.fd(), data, len);
+        }
+        zeroCopyEnabled_ = true;
+    }
+
+    ssize_t n = ::send(channel_.fd(), data, len, MSG_ZEROCOPY | MSG_NOSIGNAL);
+    if (n >= 0)
+    {
+        // Every successful MSG_ZEROCOPY send gets the next id, even if the kernel fell back to copying
+        zeroCopyPending_.emplace_back(zeroCopySeq_++, owner);
+    }
+    else if (errno == ENOBUFS) // optmem limit of pinned pages reached, copy this time
+    {
+        n = ::write(channel_.fd(), data, len);
+    }
+    return n;
+}
+
+// Read MSG_ZEROCOPY notifications from the socket error queue and unpin the completed payloads
+// Return true if the error queue only had zerocopy notifications
+bool TcpConnection::handleZeroCopyCompletions()
+{
+    return ZeroCopyLinger::reap(channel_.fd(), &zeroCopyPending_);
 }
 
-void TcpConnection::sendFile(int fileDescriptor, off_t offset, size_t count)
+void TcpConnection::sendFile(int fileDescriptor, off_t offset, size_t count,
+                             const SendFileCompleteCallback &onComplete, const SendFileProgressCallback &onProgress)
 {
     if (connected())
     {
@@ -264,65 +633,471 @@ void TcpConnection::sendFile(int fileDescriptor, off_t offset, size_t count)
         if (loop_->isInLoopThread())
         {
             // If yes, execute sendFileInLoop directly
-            sendFileInLoop(fileDescriptor, offset, count);
+            sendFileInLoop(fileDescriptor, offset, count, onComplete, onProgress);
         }
         else
         {
             // If not, wake up the loop thread to execute sendFileInLoop
-            loop_->runInLoop(std::bind(&TcpConnection::sendFileInLoop, shared_from_this(), fileDescriptor, offset, count));
+            loop_->runInLoop(std::bind(&TcpConnection::sendFileInLoop, shared_from_this(), fileDescriptor, offset, count, onComplete, onProgress));
         }
     }
     else
     {
         LOG_ERROR << "TcpConnection::sendFile - not connected";
+        if (onComplete)
+        {
+            onComplete(shared_from_this(), 0, ENOTCONN);
+        }
     }
 }
 
-void TcpConnection::sendFileInLoop(int fileDescriptor, off_t offset, size_t count)
+void TcpConnection::sendFileInLoop(int fileDescriptor, off_t offset, size_t count,
+                                   const SendFileCompleteCallback &onComplete, const SendFileProgressCallback &onProgress)
 {
-    ssize_t bytesSent = 0;    // Sent how many bytes?
-    size_t remaining = count; // Still need to send how many bytes?
-    bool faultError = false;  // Error flag
-
-    if (state_ == kDisconnecting)
+    if (state_ == kDisconnecting || state_ == kDisconnected)
     {
         // If connection is disconnecting, give up sending data
         LOG_ERROR << "disconnected, give up writing";
+        if (onComplete)
+        {
+            onComplete(shared_from_this(), 0, ENOTCONN);
+        }
         return;
     }
 
-    // Channel write first data or buffer has no data to send
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    struct stat st;
+    if (::fstat(fileDescriptor, &st) < 0)
     {
-        bytesSent = sendfile(socket_->fd(), fileDescriptor, &offset, remaining);
-        if (bytesSent >= 0)
+        int err = errno;
+        LOG_ERROR << "TcpConnection::sendFileInLoop fstat error: " << err;
+        if (onComplete)
         {
-            remaining -= bytesSent;
-            if (remaining == 0 && writeCompleteCallback_)
+            onComplete(shared_from_this(), 0, err);
+        }
+        return;
+    }
+
+    FileTransfer transfer;
+    transfer.fd = fileDescriptor;
+    transfer.offset = offset;
+    transfer.count = count;
+    transfer.remaining = count;
+    transfer.sent = 0;
+    transfer.splice = !S_ISREG(st.st_mode);
+    transfer.seekable = S_ISREG(st.st_mode) || S_ISBLK(st.st_mode);
+    transfer.onComplete = onComplete;
+    transfer.onProgress = onProgress;
+
+    if (!outputPending())
+    {
+        lastWriteTime_ = loop_->pollReturnTime(); // Output becomes pending, start the write idle clock
+    }
+
+    // outputBuffer_ holds the bytes queued before each pending file, then the bytes queued after the last one
+    transfer.bufferedBefore = outputBuffer_.readableBytes();
+    for (const FileTransfer &pending : fileTransfers_)
+    {
+        transfer.bufferedBefore -= pending.bufferedBefore;
+    }
+    fileTransfers_.push_back(std::move(transfer));
+
+    // Completion IO: the in flight SENDMSG is sent first, handleSendComplete then starts the files
+    if (sendInFlight_ || channel_.isWriting())
+    {
+        return;
+    }
+    // Try right away like sendInLoop, handleWrite keeps EPOLLOUT registered if the socket is full
+    channel_.enableWriting();
+    handleWrite();
+}
+
+ssize_t TcpConnection::transmitFile(FileTransfer &transfer, size_t maxBytes, int *savedErrno)
+{
+    if (transfer.splice)
+    {
+        return spliceFile(transfer, maxBytes, savedErrno);
+    }
+
+    ssize_t n = ::sendfile(channel_.fd(), transfer.fd, &transfer.offset, std::min(transfer.remaining, maxBytes));
+    if (n < 0)
+    {
+        *savedErrno = errno;
+        if ((errno == EINVAL || errno == ENOSYS) && transfer.sent == 0)
+        {
+            // File system can not sendfile, read it with splice instead
+            transfer.splice = true;
+            return spliceFile(transfer, maxBytes, savedErrno);
+        }
+        return n;
+    }
+    transfer.remaining -= n;
+    transfer.sent += n;
+    return n;
+}
+
+// source => loop's pipe => socket, data is moved between kernel pages without a copy to user space
+ssize_t TcpConnection::spliceFile(FileTransfer &transfer, size_t maxBytes, int *savedErrno)
+{
+    // Bytes the socket did not take last time go first
+    if (!transfer.residue.empty())
+    {
+        ssize_t n = ::write(channel_.fd(), transfer.residue.data(), std::min(transfer.residue.size(), maxBytes));
+        if (n < 0)
+        {
+            *savedErrno = errno;
+            return n;
+        }
+        transfer.residue.erase(0, n);
+        transfer.sent += n;
+        return n;
+    }
+
+    int pipeRead = -1;
+    int pipeWrite = -1;
+    if (!loop_->splicePipe(&pipeRead, &pipeWrite))
+    {
+        *savedErrno = EPIPE;
+        return -1;
+    }
+    ssize_t in = ::splice(transfer.fd, transfer.seekable ? &transfer.offset : nullptr, pipeWrite, nullptr,
+                          std::min(transfer.remaining, maxBytes), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (in <= 0)
+    {
+        *savedErrno = errno;
+        return in; // 0: end of file
+    }
+    transfer.remaining -= in;
+
+    ssize_t out = ::splice(pipeRead, nullptr, channel_.fd(), nullptr, in, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (out < 0)
+    {
+        *savedErrno = errno;
+        if (errno != EAGAIN)
+        {
+            return out;
+        }
+        out = 0;
+    }
+    transfer.sent += out;
+    if (out < in)
+    {
+        // The pipe is shared by the loop, keep what the socket did not take in the transfer
+        transfer.residue.resize(in - out);
+        size_t got = 0;
+        while (got < transfer.residue.size())
+        {
+            ssize_t r = ::read(pipeRead, &transfer.residue[got], transfer.residue.size() - got);
+            if (r <= 0)
             {
-                // remaining == 0: data all sent, no need to set write event for channel
-                loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+                break;
             }
+            got += r;
         }
-        else
+        transfer.residue.resize(got);
+        if (out == 0)
+        {
+            *savedErrno = EAGAIN;
+            return -1;
+        }
+    }
+    return out;
+}
+
+void TcpConnection::finishFileTransfer(int err)
+{
+    FileTransfer transfer = std::move(fileTransfers_.front());
+    fileTransfers_.pop_front();
+    if (!fileTransfers_.empty())
+    {
+        // Bytes after an unfinished file now belong to the next one
+        fileTransfers_.front().bufferedBefore += transfer.bufferedBefore;
+    }
+    if (transfer.onComplete)
+    {
+        transfer.onComplete(shared_from_this(), transfer.sent, err);
+    }
+}
+
+void TcpConnection::abortFileTransfers(int err)
+{
+    while (!fileTransfers_.empty())
+    {
+        finishFileTransfer(err);
+    }
+}
+
+void TcpConnection::setSocketBusyPoll(int usec)
+{
+    socket_.setBusyPoll(usec);
+}
+
+void TcpConnection::setIdleTimeouts(double readIdle, double writeIdle, double lifetime)
+{
+    readIdleTimeout_ = readIdle;
+    writeIdleTimeout_ = writeIdle;
+    lifetime_ = lifetime;
+}
+
+bool TcpConnection::outputPending() const
+{
+    return outputBuffer_.readableBytes() > 0 || !fileTransfers_.empty() || sendInFlight_;
+}
+
+// Arm the timeout timer at the nearest deadline, reads and writes only update lastReadTime_/lastWriteTime_
+void TcpConnection::scheduleTimeout(Timestamp now)
+{
+    bool enabled = false;
+    double wait = 0;
+    auto nearest = [&enabled, &wait](double left)
+    {
+        if (!enabled || left < wait)
+        {
+            wait = left;
+        }
+        enabled = true;
+    };
+    if (readIdleTimeout_ > 0)
+    {
+        nearest(readIdleTimeout_ - timeDifference(now, lastReadTime_));
+    }
+    if (writeIdleTimeout_ > 0)
+    {
+        // Nothing pending: check again one timeout later, a stall is found within twice the timeout
+        nearest(writeIdleTimeout_ - (outputPending() ? timeDifference(now, lastWriteTime_) : 0));
+    }
+    if (lifetime_ > 0 && state_ == kConnected)
+    {
+        nearest(lifetime_ - timeDifference(now, createTime_));
+    }
+    if (!enabled)
+    {
+        return;
+    }
+
+    std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+    timeoutTimer_ = loop_->runAfter(std::max(wait, 0.001),
+                                    [weakConn]()
+                                    {
+                                        TcpConnectionPtr conn = weakConn.lock();
+                                        if (conn)
+                                        {
+                                            conn->handleTimeout();
+                                        }
+                                    });
+    timeoutArmed_ = true;
+}
+
+void TcpConnection::handleTimeout()
+{
+    timeoutArmed_ = false;
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+
+    Timestamp now = Timestamp::now();
+    if (readIdleTimeout_ > 0 && timeDifference(now, lastReadTime_) >= readIdleTimeout_)
+    {
+        LOG_INFO << "TcpConnection::handleTimeout [" << name().c_str() << "] read idle, close";
+        forceCloseInLoop();
+        return;
+    }
+    if (writeIdleTimeout_ > 0 && outputPending() && timeDifference(now, lastWriteTime_) >= writeIdleTimeout_)
+    {
+        LOG_INFO << "TcpConnection::handleTimeout [" << name().c_str() << "] write idle, close";
+        forceCloseInLoop();
+        return;
+    }
+    if (lifetime_ > 0 && state_ == kConnected && timeDifference(now, createTime_) >= lifetime_)
+    {
+        LOG_INFO << "TcpConnection::handleTimeout [" << name().c_str() << "] lifetime reached, shutdown";
+        setState(kDisconnecting);
+        shutdownInLoop();
+    }
+    scheduleTimeout(now);
+}
+
+bool TcpConnection::startRecv()
+{
+    IoUringPoller *uring = loop_->ioUringPoller();
+    if (uring == nullptr || !uring->ensureProvidedBuffers())
+    {
+        return false;
+    }
+    if (!sendingBuffer_)
+    {
+        sendingBuffer_.reset(new ChainBuffer);
+    }
+
+    // The connection may be destroyed before the last recv CQE, the selected buffer must be given back anyway
+    std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+    io_uring_sqe *sqe = uring->prepareOp(
+        [weakConn, uring](int res, unsigned flags)
         {
-            // bytesSent < 0
-            if (errno != EWOULDBLOCK)
+            TcpConnectionPtr conn = weakConn.lock();
+            if (conn)
             {
-                // If not blocked and no data return, it is an error( = EAGAIN)
-                LOG_ERROR << "TcpConnection::sendFileInLoop";
+                conn->handleRecvComplete(res, flags);
             }
-            if (errno == EPIPE || errno == ECONNRESET)
+            else if (flags & IORING_CQE_F_BUFFER)
             {
-                faultError = true;
+                uring->recycleBuffer(static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT));
             }
+        },
+        &recvToken_);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = channel_.fd();
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = uring->bufferGroup();
+    return true;
+}
+
+void TcpConnection::stopCompletionIo()
+{
+    if (recvToken_ != 0)
+    {
+        loop_->ioUringPoller()->cancelOp(recvToken_);
+        recvToken_ = 0;
+    }
+    // An in flight SENDMSG holds the connection, the socket stays open until it completes,
+    // which never happens if the peer stopped reading
+    if (sendInFlight_)
+    {
+        loop_->ioUringPoller()->cancelOp(sendToken_);
+    }
+}
+
+// Multishot recv delivers data in buffers picked from the loop's provided buffer ring,
+// data is copied into inputBuffer_ once, no readv into a stack extrabuf.
+void TcpConnection::handleRecvComplete(int res, unsigned flags)
+{
+    IoUringPoller *uring = loop_->ioUringPoller();
+    if (res > 0 && state_ == kDisconnected) // Data arrived after close, recv is being cancelled
+    {
+        uring->recycleBuffer(static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT));
+        return;
+    }
+    if (res > 0)
+    {
+        uint16_t bid = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+        inputBuffer_.append(uring->providedBuffer(bid), res);
+        uring->recycleBuffer(bid);
+        lastReadTime_ = Timestamp::now();
+        messageCallback_(shared_from_this(), &inputBuffer_, lastReadTime_);
+    }
+    else if (res == 0) // Client server Connection closed
+    {
+        if (state_ != kDisconnected)
+        {
+            handleClose();
+        }
+        return;
+    }
+    else if (res == -ECANCELED)
+    {
+        return;
+    }
+    else if (res == -EINVAL && inputBuffer_.readableBytes() == 0 && recvToken_ != 0 && state_ == kConnected)
+    {
+        // Kernel does not support multishot recv(Linux 6.0+), go back to readiness path
+        LOG_ERROR << "TcpConnection::handleRecvComplete multishot recv unsupported, fall back to epoll read";
+        recvToken_ = 0;
+        channel_.enableReading();
+        return;
+    }
+    else if (res != -ENOBUFS) // ENOBUFS: provided buffers run out, just re-arm
+    {
+        errno = -res;
+        LOG_ERROR << "TcpConnection::handleRecvComplete";
+        handleError();
+        if (state_ != kDisconnected)
+        {
+            handleClose();
         }
+        return;
     }
 
-    // Process remaining data
-    if (!faultError && remaining > 0)
+    // Kernel terminated the multishot recv(buffers run out or CQ overflow), re-arm it
+    if (!(flags & IORING_CQE_F_MORE) && state_ != kDisconnected)
+    {
+        startRecv();
+    }
+}
+
+void TcpConnection::submitSend()
+{
+    // Swap pending data into sendingBuffer_, so later sendInLoop() appends never move in flight bytes
+    if (sendingBuffer_->readableBytes() == 0)
     {
-        // Sent remaining data in output buffer
-        loop_->queueInLoop(std::bind(&TcpConnection::sendFileInLoop, shared_from_this(), fileDescriptor, offset, remaining));
+        sendingBuffer_->swap(outputBuffer_);
     }
-}
\ No newline at end of file
+
+    // The SENDMSG holds the connection, its socket, sendingBuffer_ and iovecs must outlive the operation
+    TcpConnectionPtr conn(shared_from_this());
+    io_uring_sqe *sqe = loop_->ioUringPoller()->prepareOp(
+        [conn](int res, unsigned)
+        {
+            conn->handleSendComplete(res);
+        },
+        &sendToken_);
+    ::memset(&sendMsg_, 0, sizeof(sendMsg_));
+    sendMsg_.msg_iov = sendIov_;
+    sendMsg_.msg_iovlen = sendingBuffer_->fillIovec(sendIov_, sizeof(sendIov_) / sizeof(sendIov_[0]));
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = channel_.fd();
+    sqe->addr = reinterpret_cast<uint64_t>(&sendMsg_);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sendInFlight_ = true;
+}
+
+void TcpConnection::handleSendComplete(int res)
+{
+    sendInFlight_ = false;
+    if (res < 0)
+    {
+        errno = -res;
+        if (res != -ECANCELED) // ECANCELED: cancelled by stopCompletionIo()
+        {
+            LOG_ERROR << "TcpConnection::handleSendComplete";
+        }
+        if (res != -EAGAIN && res != -EINTR) // SIGPIPE RESET..., drop pending data
+        {
+            sendingBuffer_->retrieveAll();
+            outputBuffer_.retrieveAll();
+            return;
+        }
+    }
+    else
+    {
+        sendingBuffer_->retrieve(res);
+        lastWriteTime_ = loop_->pollReturnTime();
+    }
+
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+    if (sendingBuffer_->readableBytes() == 0 && !fileTransfers_.empty())
+    {
+        // Everything sent before the files is out, handleWrite sends them on EPOLLOUT
+        channel_.enableWriting();
+    }
+    else if (sendingBuffer_->readableBytes() > 0 || outputBuffer_.readableBytes() > 0)
+    {
+        submitSend();
+    }
+    else
+    {
+        if (writeCompleteCallback_)
+        {
+            loop_->queueInLoop(
+                std::bind(writeCompleteCallback_, shared_from_this()));
+        }
+        if (state_ == kDisconnecting)
+        {
+            shutdownInLoop();
+        }
+    }
+}
@@ -1,8 +1,12 @@
+#include <algorithm>
+#include <chrono>
 #include <functional>
+#include <future>
 #include <string.h>
 
 #include "TcpServer.h"
 #include "Logger.h"
+#include "PoolAllocator.h"
 #include "TcpConnection.h"
 
 static EventLoop *CheckLoopNotNull(EventLoop *loop)
@@ -18,95 +22,280 @@ TcpServer::TcpServer(EventLoop *loop,
                      const InetAddress &listenAddr,
                      const std::string &nameArg,
                      Option option)
-    : loop_(CheckLoopNotNull(loop)), ipPort_(listenAddr.toIpPort()), name_(nameArg), acceptor_(new Acceptor(loop, listenAddr, option == kReusePort)), threadPool_(new EventLoopThreadPool(loop, name_)), connectionCallback_(), messageCallback_(), nextConnId_(1), started_(0)
+    : loop_(CheckLoopNotNull(loop)), ipPort_(listenAddr.toIpPort()), name_(nameArg), listenAddr_(listenAddr), reusePortPerLoop_(option == kReusePortPerLoop), threadPool_(new EventLoopThreadPool(loop, name_)), connectionCallback_(), messageCallback_(), numThreads_(0), started_(0), completionIo_(false), edgeTriggered_(false), eventByteBudget_(1024 * 1024), zeroCopyThreshold_(0), readIdleTimeout_(0), writeIdleTimeout_(0), lifetime_(0), acceptBatch_(16), backlog_(1024), deferAcceptSeconds_(0), fastOpenQueue_(0), busyPollMicroSeconds_(0), socketBusyPollMicroSeconds_(0)
 {
+    // kReusePortPerLoop模式由各subloop绑定端口, 到start()时没有subloop才创建baseloop的acceptor
+    if (!reusePortPerLoop_)
+    {
+        createAcceptor(option != kNoReusePort);
+    }
+}
+
+void TcpServer::createAcceptor(bool reuseport)
+{
+    acceptor_.reset(new Acceptor(loop_, listenAddr_, reuseport));
+    acceptor_->setEdgeTriggered(edgeTriggered_);
     // 当有新用户连接时，Acceptor类中绑定的acceptChannel_会有读事件发生，执行handleRead()调用TcpServer::newConnection回调
-    acceptor_->setNewConnectionCallback(
-        std::bind(&TcpServer::newConnection, this, std::placeholders::_1, std::placeholders::_2));
+    acceptor_->setNewConnectionsCallback(
+        std::bind(&TcpServer::newConnections, this, std::placeholders::_1));
 }
 
 TcpServer::~TcpServer()
 {
-    for (auto &item : connections_)
+    // loop的acceptor和连接只能在loop线程中销毁, 同步等待其完成
+    // loop已经退出(hasExited)时不会再执行任务, 此时loop线程不再访问这些对象, 直接在当前线程销毁
+    // loop尚未开始循环时仍可能有已入队的任务(如Acceptor::listen), 必须入队销毁任务并等待
+    for (auto &item : loopConnections_)
     {
-        TcpConnectionPtr conn(item.second);
-        item.second.reset(); // 把原始的智能指针复位 让栈空间的TcpConnectionPtr conn指向该对象 当conn出了其作用域 即可释放智能指针指向的对象
-        // 销毁连接
-        conn->getLoop()->runInLoop(
-            std::bind(&TcpConnection::connectDestroyed, conn));
+        LoopConnections *loopConnections = item.get();
+        EventLoop *ioLoop = loopConnections->loop;
+        if (ioLoop->isInLoopThread() || ioLoop->hasExited())
+        {
+            destroyLoopConnections(loopConnections);
+            continue;
+        }
+        std::shared_ptr<std::promise<void>> done = std::make_shared<std::promise<void>>();
+        std::future<void> destroyed = done->get_future();
+        ioLoop->runInLoop(
+            [loopConnections, done]()
+            {
+                destroyLoopConnections(loopConnections);
+                done->set_value();
+            });
+        // 任务可能在loop最后一次执行任务之后才入队而永远不会执行, 因此周期性检查hasExited()
+        // hasExited()为true后任务仍未完成, 说明它不会再被执行, loop线程也不再访问这些对象
+        while (destroyed.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready)
+        {
+            if (ioLoop->hasExited() && destroyed.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                destroyLoopConnections(loopConnections);
+                break;
+            }
+        }
+    }
+}
+
+// 开启边缘触发模式
+void TcpServer::setEdgeTriggered(bool on, size_t eventByteBudget)
+{
+    edgeTriggered_ = on;
+    eventByteBudget_ = eventByteBudget;
+    if (acceptor_)
+    {
+        acceptor_->setEdgeTriggered(on);
     }
 }
 
 // 设置底层subloop的个数
 void TcpServer::setThreadNum(int numThreads)
 {
-    int numThreads_ = numThreads;
+    numThreads_ = numThreads;
     threadPool_->setThreadNum(numThreads_);
 }
 
+std::vector<EventLoop::BusyPollStats> TcpServer::busyPollStats() const
+{
+    std::vector<EventLoop::BusyPollStats> stats;
+    for (EventLoop *ioLoop : threadPool_->getAllLoops())
+    {
+        stats.push_back(ioLoop->busyPollStats());
+    }
+    return stats;
+}
+
 // 开启服务器监听
 void TcpServer::start()
 {
     if (started_.fetch_add(1) == 0) // 防止一个TcpServer对象被start多次
     {
+        std::shared_ptr<UserCallbacks> callbacks(new UserCallbacks);
+        callbacks->connection = connectionCallback_;
+        callbacks->message = messageCallback_;
+        callbacks->writeComplete = writeCompleteCallback_;
+        userCallbacks_ = callbacks;
+
         threadPool_->start(threadInitCallback_); // 启动底层的loop线程池
-        loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        if (busyPollMicroSeconds_ > 0)
+        {
+            for (EventLoop *ioLoop : threadPool_->getAllLoops())
+            {
+                ioLoop->runInLoop(std::bind(&EventLoop::setBusyPoll, ioLoop, busyPollMicroSeconds_));
+            }
+        }
+        // 每个subloop绑定同一端口各自监听, 内核按四元组哈希分发SYN
+        const bool loopAcceptors = reusePortPerLoop_ && numThreads_ > 0;
+        std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+        for (size_t i = 0; i < loops.size(); ++i)
+        {
+            std::unique_ptr<LoopConnections> loopConnections(new LoopConnections);
+            loopConnections->loop = loops[i];
+            loopConnections->id = static_cast<int>(i);
+            loopConnections->namePrefix = std::make_shared<const std::string>(name_ + "-" + ipPort_ + "#" + std::to_string(i) + "-");
+            if (loopAcceptors)
+            {
+                loopConnections->acceptor.reset(new Acceptor(loops[i], listenAddr_, true));
+                loopConnections->acceptor->setEdgeTriggered(edgeTriggered_);
+                configureAcceptor(loopConnections->acceptor.get());
+                LoopConnections *connectionsOfLoop = loopConnections.get();
+                loopConnections->acceptor->setNewConnectionCallback(
+                    [this, connectionsOfLoop](int sockfd, const InetAddress &peerAddr)
+                    { newLoopConnection(connectionsOfLoop, sockfd, peerAddr); });
+                loops[i]->runInLoop(std::bind(&Acceptor::listen, loopConnections->acceptor.get()));
+            }
+            loopConnections_.push_back(std::move(loopConnections));
+        }
+        if (!loopAcceptors)
+        {
+            if (!acceptor_)
+            {
+                // kReusePortPerLoop模式但没有subloop, 由baseloop监听
+                createAcceptor(true);
+            }
+            configureAcceptor(acceptor_.get());
+            loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        }
     }
 }
 
-// 有一个新用户连接，acceptor会执行这个回调操作，负责将mainLoop接收到的请求连接(acceptChannel_会有读事件发生)通过回调轮询分发给subLoop去处理
-void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
+void TcpServer::configureAcceptor(Acceptor *acceptor)
 {
-    // 轮询算法 选择一个subLoop 来管理connfd对应的channel
-    EventLoop *ioLoop = threadPool_->getNextLoop(peerAddr.toIp());
-    char buf[64] = {0};
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_; // 这里没有设置为原子类是因为其只在mainloop中执行 不涉及线程安全问题
-    std::string connName = name_ + buf;
+    acceptor->setAcceptBatch(acceptBatch_);
+    acceptor->setListenOptions(backlog_, deferAcceptSeconds_, fastOpenQueue_);
+}
 
-    LOG_INFO << "TcpServer::newConnection [" << name_.c_str() << "]- new connection [" << connName.c_str() << "]from %s" << peerAddr.toIpPort().c_str();
+void TcpServer::destroyLoopConnections(LoopConnections *loopConnections)
+{
+    loopConnections->acceptor.reset();
+    for (TcpConnectionPtr &conn : loopConnections->connections.takeAll())
+    {
+        conn->connectDestroyed();
+    }
+}
 
-    // 通过sockfd获取其绑定的本机的ip地址和端口信息
-    sockaddr_in local;
-    ::memset(&local, 0, sizeof(local));
-    socklen_t addrlen = sizeof(local);
-    if (::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0)
+// 有新用户连接，acceptor会执行这个回调操作，负责将mainLoop接收到的一批连接(acceptChannel_会有读事件发生)分发给subLoop去处理
+void TcpServer::newConnections(const Acceptor::AcceptedList &accepted)
+{
+    // 按subloop分组, 每个subloop只唤醒一次, 连接对象由subloop自己创建
+    std::vector<std::pair<EventLoop *, std::vector<EventLoop::Functor>>> handoffs;
+    for (const auto &item : accepted)
     {
-        LOG_ERROR << "sockets::getLocalAddr";
+        // 按线程池的分配策略(默认轮询) 选择一个subLoop 来管理connfd对应的channel, 只有按ip分配的策略才格式化ip字符串
+        const InetAddress &peerAddr = item.second;
+        EventLoop *ioLoop = threadPool_->getNextLoop(peerAddr);
+        auto it = std::find_if(handoffs.begin(), handoffs.end(),
+                               [ioLoop](const std::pair<EventLoop *, std::vector<EventLoop::Functor>> &handoff)
+                               { return handoff.first == ioLoop; });
+        if (it == handoffs.end())
+        {
+            handoffs.emplace_back(ioLoop, std::vector<EventLoop::Functor>());
+            it = handoffs.end() - 1;
+        }
+        LoopConnections *loopConnections = loopConnectionsOf(ioLoop);
+        int sockfd = item.first;
+        it->second.push_back(
+            [this, loopConnections, sockfd, peerAddr]()
+            { newLoopConnection(loopConnections, sockfd, peerAddr); });
+    }
+    for (auto &handoff : handoffs)
+    {
+        handoff.first->runInLoopBatch(std::move(handoff.second));
     }
+}
 
-    InetAddress localAddr(local);
-    TcpConnectionPtr conn(new TcpConnection(ioLoop,
-                                            connName,
-                                            sockfd,
-                                            localAddr,
-                                            peerAddr));
-    connections_[connName] = conn;
-    // 下面的回调都是用户设置给TcpServer => TcpConnection的，至于Channel绑定的则是TcpConnection设置的四个，handleRead,handleWrite... 这下面的回调用于handlexxx函数中
-    conn->setConnectionCallback(connectionCallback_);
-    conn->setMessageCallback(messageCallback_);
-    conn->setWriteCompleteCallback(writeCompleteCallback_);
+TcpServer::LoopConnections *TcpServer::loopConnectionsOf(EventLoop *ioLoop)
+{
+    for (auto &item : loopConnections_)
+    {
+        if (item->loop == ioLoop)
+        {
+            return item.get();
+        }
+    }
+    LOG_FATAL << "TcpServer::loopConnectionsOf loop is not in the thread pool";
+    return nullptr;
+}
 
-    // 设置了如何关闭连接的回调
-    conn->setCloseCallback(
-        std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
+// 在所属loop线程中执行: baseloop移交的连接, 或者kReusePortPerLoop模式下该subloop自己accept到的连接
+void TcpServer::newLoopConnection(LoopConnections *loopConnections, int sockfd, const InetAddress &peerAddr)
+{
+    uint64_t id = loopConnections->connections.reserve(); // 连接表只在该loop中访问 不涉及线程安全问题
+    TcpConnectionPtr conn = createConnection(loopConnections->loop, id, loopConnections->namePrefix, sockfd, peerAddr);
+    loopConnections->connections.set(id, conn);
 
-    ioLoop->runInLoop(
-        std::bind(&TcpConnection::connectEstablished, conn));
+    LOG_INFO << "TcpServer::newLoopConnection [" << name_.c_str() << "]- new connection [" << conn->name().c_str() << "]from " << peerAddr.toIpPort().c_str();
+
+    // 设置了如何关闭连接的回调, 只捕获两个指针, 不需要为std::function分配内存
+    conn->setCloseCallback(
+        [this, loopConnections](const TcpConnectionPtr &closed)
+        { removeLoopConnection(loopConnections, closed); });
+    conn->connectEstablished();
 }
 
-void TcpServer::removeConnection(const TcpConnectionPtr &conn)
+// 连接关闭回调在其所属loop中执行, 连接表也属于该loop, 无需转到baseloop
+void TcpServer::removeLoopConnection(LoopConnections *loopConnections, const TcpConnectionPtr &conn)
 {
-    loop_->runInLoop(
-        std::bind(&TcpServer::removeConnectionInLoop, this, conn));
+    LOG_INFO << "TcpServer::removeLoopConnection [" << name_.c_str() << "] - connection " << conn->name().c_str();
+
+    loopConnections->connections.erase(conn->id());
+    if (!loopConnections->acceptor)
+    {
+        threadPool_->releaseLoop(loopConnections->loop); // 由线程池分配的连接, 该loop的连接数减一
+    }
+    loopConnections->loop->queueInLoop(
+        std::bind(&TcpConnection::connectDestroyed, conn));
 }
 
-void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
+TcpConnectionPtr TcpServer::createConnection(EventLoop *ioLoop, uint64_t id, const std::shared_ptr<const std::string> &namePrefix, int sockfd, const InetAddress &peerAddr)
 {
-    LOG_INFO << "TcpServer::removeConnectionInLoop [" << name_.c_str() << "] - connection %s" << conn->name().c_str();
+    // 通过sockfd获取其绑定的本机的ip地址和端口信息
+    sockaddr_in local;
+    ::memset(&local, 0, sizeof(local));
+    socklen_t addrlen = sizeof(local);
+    if (::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0)
+    {
+        LOG_ERROR << "sockets::getLocalAddr";
+    }
 
-    connections_.erase(conn->name());
-    EventLoop *ioLoop = conn->getLoop();
-    ioLoop->queueInLoop(
-        std::bind(&TcpConnection::connectDestroyed, conn));
-}
\ No newline at end of file
+    InetAddress localAddr(local);
+    // 连接对象和shared_ptr控制块从内存池一次分配, 短连接频繁建立关闭时不走malloc
+    // 在所属loop线程中分配, 内存来自该线程(所在NUMA节点)的缓存; 释放时回到最后一个TcpConnectionPtr析构所在线程的缓存,
+    // 通常也是该loop线程, 但在其他线程析构时内存归入那个线程的缓存(见PoolAllocator)
+    TcpConnectionPtr conn = std::allocate_shared<TcpConnection>(RainMemoPool::PoolAllocator<TcpConnection>(),
+                                                                ioLoop,
+                                                                id,
+                                                                namePrefix,
+                                                                sockfd,
+                                                                localAddr,
+                                                                peerAddr);
+    // 下面的回调都是用户设置给TcpServer => TcpConnection的，至于Channel绑定的则是TcpConnection设置的四个，handleRead,handleWrite... 这下面的回调用于handlexxx函数中
+    // 每个连接的回调只捕获共享快照的裸指针, 放得进std::function内部, 不再为每个连接拷贝用户的回调对象, 连接持有快照保证其存活
+    const UserCallbacks *callbacks = userCallbacks_.get();
+    conn->setCallbackOwner(userCallbacks_);
+    if (callbacks->connection)
+    {
+        conn->setConnectionCallback(
+            [callbacks](const TcpConnectionPtr &c)
+            { callbacks->connection(c); });
+    }
+    if (callbacks->message)
+    {
+        conn->setMessageCallback(
+            [callbacks](const TcpConnectionPtr &c, Buffer *buf, Timestamp time)
+            { callbacks->message(c, buf, time); });
+    }
+    if (callbacks->writeComplete)
+    {
+        conn->setWriteCompleteCallback(
+            [callbacks](const TcpConnectionPtr &c)
+            { callbacks->writeComplete(c); });
+    }
+    conn->setCompletionIo(completionIo_);
+    conn->setEdgeTriggered(edgeTriggered_, eventByteBudget_);
+    conn->setZeroCopyThreshold(zeroCopyThreshold_);
+    conn->setIdleTimeouts(readIdleTimeout_, writeIdleTimeout_, lifetime_);
+    if (socketBusyPollMicroSeconds_ > 0)
+    {
+        conn->setSocketBusyPoll(socketBusyPollMicroSeconds_);
+    }
+    return conn;
+}
@@ -0,0 +1,101 @@
+#include <time.h> // for timespec in linux/errqueue.h
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <string.h>
+#include <unistd.h> // for close
+
+#include "EventLoop.h"
+#include "ZeroCopyLinger.h"
+
+// Completions of a closed connection come once the peer acked or the kernel dropped the data
+static const double kPollInterval = 0.01;
+
+ZeroCopyLinger::ZeroCopyLinger(EventLoop *loop)
+    : loop_(loop), timerArmed_(false)
+{
+}
+
+ZeroCopyLinger::~ZeroCopyLinger()
+{
+    // The timer goes with the loop's TimerQueue
+    for (auto &socket : sockets_)
+    {
+        ::close(socket.first);
+    }
+}
+
+void ZeroCopyLinger::add(int fd, Pending &&pending)
+{
+    sockets_.emplace_back(fd, std::move(pending));
+    if (!timerArmed_)
+    {
+        timer_ = loop_->runEvery(kPollInterval, [this]() { poll(); });
+        timerArmed_ = true;
+    }
+}
+
+void ZeroCopyLinger::poll()
+{
+    for (size_t i = 0; i < sockets_.size();)
+    {
+        reap(sockets_[i].first, &sockets_[i].second);
+        if (sockets_[i].second.empty())
+        {
+            ::close(sockets_[i].first);
+            sockets_[i] = std::move(sockets_.back());
+            sockets_.pop_back();
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    if (sockets_.empty())
+    {
+        loop_->cancel(timer_);
+        timerArmed_ = false;
+    }
+}
+
+bool ZeroCopyLinger::reap(int fd, Pending *pending)
+{
+    bool zeroCopyOnly = true;
+    char control[128];
+    for (;;)
+    {
+        struct msghdr msg;
+        ::memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (::recvmsg(fd, &msg, MSG_ERRQUEUE) < 0)
+        {
+            break; // EAGAIN: error queue drained
+        }
+
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            bool recvErr = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                           (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+            if (!recvErr)
+            {
+                continue;
+            }
+            const struct sock_extended_err *serr = reinterpret_cast<const struct sock_extended_err *>(CMSG_DATA(cm));
+            if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno != 0)
+            {
+                zeroCopyOnly = false;
+                continue;
+            }
+            // Sends [ee_info, ee_data] are done, ids are 32 bit and wrap around
+            uint32_t lo = serr->ee_info;
+            uint32_t hi = serr->ee_data;
+            while (!pending->empty() && pending->front().first - lo <= hi - lo)
+            {
+                pending->pop_front();
+            }
+        }
+    }
+    return zeroCopyOnly;
+}
@@ -0,0 +1,126 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <unordered_map>
+
+#include "BinaryLog.h"
+
+// Render binary log files written by AsyncLogging::setBinary(true) as text lines
+// Usage: raindecode file.blog...
+
+static bool readFile(const char *path, std::string *content)
+{
+    FILE *file = ::fopen(path, "rb");
+    if (!file)
+    {
+        ::fprintf(stderr, "raindecode: can not open %s: %s\n", path, ::strerror(errno));
+        return false;
+    }
+    char buf[64 * 1024];
+    size_t n;
+    while ((n = ::fread(buf, 1, sizeof(buf), file)) > 0)
+    {
+        content->append(buf, n);
+    }
+    ::fclose(file);
+    return true;
+}
+
+// Call onRecord for each complete record, return false if the file ends in the middle of a record
+template <typename OnRecord>
+static bool forEachRecord(const std::string &content, OnRecord onRecord)
+{
+    size_t pos = sizeof(BinaryLog::kFileMagic);
+    while (pos + sizeof(BinaryLog::RecordHeader) <= content.size())
+    {
+        BinaryLog::RecordHeader header;
+        memcpy(&header, content.data() + pos, sizeof(header));
+        if (header.length < sizeof(header) || pos + header.length > content.size())
+        {
+            return false;
+        }
+        onRecord(header, content.data() + pos + sizeof(header), header.length - sizeof(header));
+        pos += header.length;
+    }
+    return pos == content.size();
+}
+
+static int decodeFile(const char *path, std::unordered_map<uint32_t, BinaryLog::Format> &formats)
+{
+    std::string content;
+    if (!readFile(path, &content))
+    {
+        return 1;
+    }
+    if (content.size() < sizeof(BinaryLog::kFileMagic) ||
+        memcmp(content.data(), BinaryLog::kFileMagic, sizeof(BinaryLog::kFileMagic)) != 0)
+    {
+        ::fprintf(stderr, "raindecode: %s is not a binary log file\n", path);
+        return 1;
+    }
+
+    // First pass: the format dictionary, an entry may come after the first records using it
+    forEachRecord(content, [&](const BinaryLog::RecordHeader &header, const char *payload, size_t len)
+                  {
+                      BinaryLog::Format format;
+                      if (header.formatId == BinaryLog::kDictionaryId && BinaryLog::parseDictionary(payload, len, &format))
+                      {
+                          formats[format.id] = format;
+                      } });
+
+    // Second pass: render records in file order
+    int result = 0;
+    std::string line;
+    bool complete = forEachRecord(content, [&](const BinaryLog::RecordHeader &header, const char *payload, size_t len)
+                                  {
+                                      line.clear();
+                                      if (header.formatId == BinaryLog::kDictionaryId)
+                                      {
+                                          return;
+                                      }
+                                      if (header.formatId == BinaryLog::kTextFormatId)
+                                      {
+                                          line.assign(payload, len);
+                                      }
+                                      else
+                                      {
+                                          auto it = formats.find(header.formatId);
+                                          if (it == formats.end())
+                                          {
+                                              ::fprintf(stderr, "raindecode: %s: unknown format id %u\n", path, header.formatId);
+                                              result = 1;
+                                              return;
+                                          }
+                                          if (!BinaryLog::formatRecord(it->second, header.time, payload, len, &line))
+                                          {
+                                              result = 1;
+                                          }
+                                      }
+                                      ::fwrite(line.data(), 1, line.size(), stdout); });
+    if (!complete)
+    {
+        // Usually the tail of a file the process was writing when it died
+        ::fprintf(stderr, "raindecode: %s: truncated record at end of file\n", path);
+        result = 1;
+    }
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        ::fprintf(stderr, "usage: %s file.blog...\n", argv[0]);
+        return 2;
+    }
+    int result = 0;
+    // Formats are kept across files, so rolled files of one run can be decoded together
+    std::unordered_map<uint32_t, BinaryLog::Format> formats;
+    for (int i = 1; i < argc; ++i)
+    {
+        result |= decodeFile(argv[i], formats);
+    }
+    return result;
+}
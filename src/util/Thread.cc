@@ -1,6 +1,11 @@
+#include <pthread.h>
+#include <sched.h>
 #include <semaphore.h>
+#include <sys/syscall.h>
 
 #include "CurrentThread.h"
+#include "Logger.h"
+#include "Numa.h"
 #include "Thread.h"
 
 std::atomic_int Thread::numCreated_(0);
@@ -28,6 +33,7 @@ void Thread::start()
     thread_ = std::shared_ptr<std::thread>(new std::thread([&]()
                                                            {
                                                                tid_ = CurrentThread::tid(); // Get thread id
+                                                               initInThread();
                                                                sem_post(&sem);
                                                                func_(); // Start new thread, and run the callback function
                                                            }));
@@ -52,3 +58,45 @@ void Thread::setDefaultName()
         name_ = buf;
     }
 }
+
+void Thread::initInThread()
+{
+    // Shown by top -H and in core dumps, Linux limits the name to 15 characters
+    ::pthread_setname_np(::pthread_self(), name_.substr(0, 15).c_str());
+
+    if (cpus_.empty())
+    {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    bool any = false;
+    for (int cpu : cpus_)
+    {
+        // CPU_SET does not check the range, an id outside cpu_set_t would write past it
+        if (cpu < 0 || cpu >= CPU_SETSIZE)
+        {
+            LOG_ERROR << "Thread::initInThread " << name_ << " ignores invalid cpu id " << cpu;
+            continue;
+        }
+        CPU_SET(cpu, &set);
+        any = true;
+    }
+    if (!any)
+    {
+        return;
+    }
+    int err = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+    if (err != 0)
+    {
+        LOG_ERROR << "Thread::initInThread pthread_setaffinity_np " << name_ << " errno: " << err;
+        return;
+    }
+    // The thread already runs on one of cpus, use the memory pool arena of its NUMA node
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if (::syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+    {
+        RainMemoPool::Numa::setCurrentNode(static_cast<int>(node));
+    }
+}
@@ -1,5 +1,8 @@
+#include "MemoryPool.h"
 #include "Timer.h"
 
+std::atomic<int64_t> Timer::s_numCreated_(0);
+
 void Timer::restart(Timestamp now)
 {
     if (repeat_)
@@ -11,4 +14,13 @@ void Timer::restart(Timestamp now)
     {
         expiration_ = Timestamp();
     }
-}
\ No newline at end of file
+}
+void *Timer::operator new(size_t size)
+{
+    return RainMemoPool::MemoryPool::allocate(size);
+}
+
+void Timer::operator delete(void *ptr, size_t size)
+{
+    RainMemoPool::MemoryPool::deallocate(ptr, size);
+}
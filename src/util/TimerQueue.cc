@@ -4,6 +4,8 @@
 
 #include <string.h>
 
+#include <algorithm>
+
 #include "Channel.h"
 #include "EventLoop.h"
 #include "Logger.h"
@@ -29,7 +31,10 @@ TimerQueue::TimerQueue(EventLoop *loop)
     : loop_(loop),
       timerfd_(createTimerfd()),
       timerfdChannel_(loop_, timerfd_),
-      timers_()
+      currentTick_(toTick(Timestamp::now())),
+      armedTick_(0),
+      count_(0),
+      callingExpiredTimers_(false)
 {
     timerfdChannel_.setReadCallback(
         std::bind(&TimerQueue::handleRead, this));
@@ -42,43 +47,77 @@ TimerQueue::~TimerQueue()
     timerfdChannel_.remove();
     ::close(timerfd_);
     // 删除所有定时器
-    for (const Entry &timer : timers_)
+    auto deleteSlot = [](Slot &slot)
+    {
+        while (slot.head)
+        {
+            Timer *timer = slot.head;
+            slot.head = timer->next_;
+            delete timer;
+        }
+    };
+    for (Slot &slot : root_)
+    {
+        deleteSlot(slot);
+    }
+    for (auto &level : levels_)
     {
-        delete timer.second;
+        for (Slot &slot : level)
+        {
+            deleteSlot(slot);
+        }
     }
 }
 
-void TimerQueue::addTimer(TimerCallback cb,
-                          Timestamp when,
-                          double interval)
+TimerId TimerQueue::addTimer(TimerCallback cb,
+                             Timestamp when,
+                             double interval)
 {
     Timer *timer = new Timer(std::move(cb), when, interval);
+    // Read before handing the timer to the loop, which may fire and delete it at once
+    const int64_t sequence = timer->sequence();
     loop_->runInLoop(
         std::bind(&TimerQueue::addTimerInLoop, this, timer));
+    return TimerId(timer, sequence);
+}
+
+void TimerQueue::cancel(TimerId timerId)
+{
+    loop_->runInLoop(
+        std::bind(&TimerQueue::cancelInLoop, this, timerId));
 }
 
 void TimerQueue::addTimerInLoop(Timer *timer)
 {
-    // 是否取代了最早的定时触发时间
-    bool eraliestChanged = insert(timer);
+    timer->tick_ = toTick(timer->expiration());
+    insert(timer);
+    ++count_;
+    activeTimers_.emplace(timer->sequence(), timer);
 
-    // 我们需要重新设置timerfd_触发时间
-    if (eraliestChanged)
+    // 比timerfd_当前的到期时间更早, 需要重新设置timerfd_触发时间
+    if (armedTick_ == 0 || timer->tick_ < armedTick_)
     {
-        resetTimerfd(timerfd_, timer->expiration());
+        resetTimerfd(timerfd_, timer->tick_);
     }
 }
 
+uint64_t TimerQueue::toTick(Timestamp when)
+{
+    return (when.microSecondsSinceEpoch() + kTickMicroSeconds - 1) / kTickMicroSeconds;
+}
+
 // 重置timerfd
-void TimerQueue::resetTimerfd(int timerfd_, Timestamp expiration)
+void TimerQueue::resetTimerfd(int timerfd_, uint64_t tick)
 {
+    armedTick_ = tick;
+
     struct itimerspec newValue;
     struct itimerspec oldValue;
     memset(&newValue, '\0', sizeof(newValue));
     memset(&oldValue, '\0', sizeof(oldValue));
 
     // 超时时间 - 现在时间
-    int64_t microSecondDif = expiration.microSecondsSinceEpoch() - Timestamp::now().microSecondsSinceEpoch();
+    int64_t microSecondDif = static_cast<int64_t>(tick) * kTickMicroSeconds - Timestamp::now().microSecondsSinceEpoch();
     if (microSecondDif < 100)
     {
         microSecondDif = 100;
@@ -108,75 +147,225 @@ void ReadTimerFd(int timerfd)
     }
 }
 
-// 返回删除的定时器节点 （std::vector<Entry> expired）
-std::vector<TimerQueue::Entry> TimerQueue::getExpired(Timestamp now)
+void TimerQueue::insert(Timer *timer)
 {
-    std::vector<Entry> expired;
-    Entry sentry(now, reinterpret_cast<Timer *>(UINTPTR_MAX));
-    TimerList::iterator end = timers_.lower_bound(sentry);
-    std::copy(timers_.begin(), end, back_inserter(expired));
-    timers_.erase(timers_.begin(), end);
-
-    return expired;
+    // 已经到期的定时器放到下一个要处理的tick, 超出时间轮范围的先放在最高层
+    uint64_t expires = timer->tick_ < currentTick_ ? currentTick_ : timer->tick_;
+    uint64_t idx = expires - currentTick_;
+    if (idx < static_cast<uint64_t>(kRootSize))
+    {
+        link(root_[expires & (kRootSize - 1)], timer);
+        return;
+    }
+    for (int level = 1; level < kLevels; ++level)
+    {
+        int shift = kRootBits + level * kLevelBits;
+        if (idx < (1ULL << shift) || level == kLevels - 1)
+        {
+            if (idx >= (1ULL << shift))
+            {
+                expires = currentTick_ + (1ULL << shift) - 1;
+            }
+            link(levels_[level - 1][(expires >> (shift - kLevelBits)) & (kLevelSize - 1)], timer);
+            return;
+        }
+    }
 }
 
-void TimerQueue::handleRead()
+void TimerQueue::link(Slot &slot, Timer *timer)
 {
-    Timestamp now = Timestamp::now();
-    ReadTimerFd(timerfd_);
+    timer->slot_ = &slot;
+    timer->next_ = nullptr;
+    timer->prev_ = slot.tail;
+    if (slot.tail)
+    {
+        slot.tail->next_ = timer;
+    }
+    else
+    {
+        slot.head = timer;
+    }
+    slot.tail = timer;
+}
 
-    std::vector<Entry> expired = getExpired(now);
+void TimerQueue::unlink(Timer *timer)
+{
+    Slot &slot = *static_cast<Slot *>(timer->slot_);
+    if (timer->prev_)
+    {
+        timer->prev_->next_ = timer->next_;
+    }
+    else
+    {
+        slot.head = timer->next_;
+    }
+    if (timer->next_)
+    {
+        timer->next_->prev_ = timer->prev_;
+    }
+    else
+    {
+        slot.tail = timer->prev_;
+    }
+    timer->prev_ = timer->next_ = nullptr;
+    timer->slot_ = nullptr;
+}
 
-    // 遍历到期的定时器，调用回调函数
-    callingExpiredTimers_ = true;
-    for (const Entry &it : expired)
+void TimerQueue::cancelInLoop(TimerId timerId)
+{
+    // 序号唯一, 找不到说明已经到期释放或已取消; 只比较地址, 不访问可能已释放的内存
+    auto it = activeTimers_.find(timerId.sequence_);
+    if (it == activeTimers_.end() || it->second != timerId.timer_)
     {
-        it.second->run();
+        return;
     }
-    callingExpiredTimers_ = false;
+    Timer *timer = it->second;
+    if (timer->slot_)
+    {
+        // 还在时间轮中, O(1)摘除
+        unlink(timer);
+        --count_;
+        activeTimers_.erase(it);
+        delete timer;
+    }
+    else if (callingExpiredTimers_)
+    {
+        // 属于正在处理的这批到期定时器, 由handleRead跳过并释放
+        cancelingTimers_.insert(timerId.sequence_);
+    }
+}
 
-    // 重新设置这些定时器
-    reset(expired, now);
+int TimerQueue::cascade(int level, int index)
+{
+    Slot &slot = levels_[level - 1][index];
+    Timer *timer = slot.head;
+    slot.head = slot.tail = nullptr;
+    while (timer)
+    {
+        Timer *next = timer->next_;
+        insert(timer);
+        timer = next;
+    }
+    return index;
 }
 
-void TimerQueue::reset(const std::vector<Entry> &expired, Timestamp now)
+void TimerQueue::advance(uint64_t nowTick, std::vector<Timer *> &expired)
 {
-    Timestamp nextExpire;
-    for (const Entry &it : expired)
+    while (count_ > 0 && currentTick_ <= nowTick)
     {
-        // 重复任务则继续执行
-        if (it.second->repeat())
+        // 跳过中间没有定时器的tick
+        uint64_t next = nextEventTick();
+        if (next > nowTick)
         {
-            auto timer = it.second;
-            timer->restart(Timestamp::now());
-            insert(timer);
+            break;
         }
-        else
+        currentTick_ = next;
+
+        // 第0层转完一圈, 把高层对应槽位的定时器下移
+        int index = static_cast<int>(currentTick_ & (kRootSize - 1));
+        if (index == 0)
         {
-            delete it.second;
+            for (int level = 1; level < kLevels; ++level)
+            {
+                int shift = kRootBits + (level - 1) * kLevelBits;
+                if (cascade(level, static_cast<int>((currentTick_ >> shift) & (kLevelSize - 1))) != 0)
+                {
+                    break;
+                }
+            }
         }
 
-        // 如果重新插入了定时器，需要继续重置timerfd
-        if (!timers_.empty())
+        // 整个槽位批量到期, 先推进currentTick_, 回调中新加的到期定时器落到下一个tick
+        Slot &slot = root_[index];
+        for (Timer *timer = slot.head; timer; timer = timer->next_)
         {
-            resetTimerfd(timerfd_, (timers_.begin()->second)->expiration());
+            timer->slot_ = nullptr;
+            expired.push_back(timer);
+            --count_;
         }
+        slot.head = slot.tail = nullptr;
+        ++currentTick_;
+    }
+    if (currentTick_ <= nowTick)
+    {
+        currentTick_ = nowTick + 1;
     }
 }
 
-bool TimerQueue::insert(Timer *timer)
+uint64_t TimerQueue::nextEventTick() const
 {
-    bool earliestChanged = false;
-    Timestamp when = timer->expiration();
-    TimerList::iterator it = timers_.begin();
-    if (it == timers_.end() || when < it->first)
+    if (count_ == 0)
     {
-        // 说明最早的定时器已经被替换了
-        earliestChanged = true;
+        return 0;
     }
+    uint64_t next = UINT64_MAX;
+    for (int k = 0; k < kRootSize; ++k)
+    {
+        if (root_[(currentTick_ + k) & (kRootSize - 1)].head)
+        {
+            next = currentTick_ + k;
+            break;
+        }
+    }
+    // 高层槽位在它的起始tick下移, 从不早于currentTick_的第一个起始tick开始找, 第g个槽位的起始tick是g << shift
+    for (int level = 1; level < kLevels; ++level)
+    {
+        int shift = kRootBits + (level - 1) * kLevelBits;
+        uint64_t first = (currentTick_ + (1ULL << shift) - 1) >> shift;
+        for (uint64_t g = first; g < first + kLevelSize; ++g)
+        {
+            if (levels_[level - 1][g & (kLevelSize - 1)].head)
+            {
+                next = std::min(next, g << shift);
+                break;
+            }
+        }
+    }
+    return next;
+}
 
-    // 定时器管理红黑树插入此新定时器
-    timers_.insert(Entry(when, timer));
+void TimerQueue::handleRead()
+{
+    Timestamp now = Timestamp::now();
+    ReadTimerFd(timerfd_);
+    armedTick_ = 0;
+
+    std::vector<Timer *> expired;
+    advance(static_cast<uint64_t>(now.microSecondsSinceEpoch()) / kTickMicroSeconds, expired);
+
+    // 遍历到期的定时器，调用回调函数, 跳过被本批前面的回调取消的定时器
+    callingExpiredTimers_ = true;
+    cancelingTimers_.clear();
+    for (Timer *timer : expired)
+    {
+        if (cancelingTimers_.empty() || cancelingTimers_.count(timer->sequence()) == 0)
+        {
+            timer->run();
+        }
+    }
+    callingExpiredTimers_ = false;
+
+    // 重复任务重新放回时间轮, 一次性任务和被取消的任务释放
+    for (Timer *timer : expired)
+    {
+        if (timer->repeat() && cancelingTimers_.count(timer->sequence()) == 0)
+        {
+            timer->restart(now);
+            timer->tick_ = toTick(timer->expiration());
+            insert(timer);
+            ++count_;
+        }
+        else
+        {
+            activeTimers_.erase(timer->sequence());
+            delete timer;
+        }
+    }
 
-    return earliestChanged;
-}
\ No newline at end of file
+    // 所有到期定时器处理完只设置一次timerfd_
+    uint64_t next = nextEventTick();
+    if (next != 0 && next != armedTick_)
+    {
+        resetTimerfd(timerfd_, next);
+    }
+}